@@ -0,0 +1,318 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "qualifier_utils.hpp"
+
+template <typename T, typename TStorage>
+constexpr decltype(auto) storage_cast(TStorage* storage) noexcept
+{
+    static_assert(sizeof(typename TStorage::type) >= sizeof(T), // .
+        "`TStorage` is not big enough for `T`.");
+
+    static_assert(alignof(typename TStorage::type) >= alignof(T), // .
+        "`TStorage` is not properly aligned for `T`.");
+
+    assert(storage != nullptr);
+
+    using return_type = copy_cv_qualifiers<T, TStorage>;
+    return reinterpret_cast<return_type*>(storage);
+}
+
+// On 64-bit hosts, node-based data structures spend a lot of memory on
+// pointers: a binary tree node holding an `int` is 24 bytes, 16 of which are
+// child pointers.
+
+// If all nodes live in a single arena smaller than 4GB, a node can be
+// identified by a 32-bit offset from the arena's base address instead.
+// Keeping the base in a static variable (one per arena "tag") means that the
+// compressed pointer doesn't need to store it, and that dereferencing is a
+// single addition.
+
+template <typename TTag>
+class arena
+{
+public:
+    // The arena's base is aligned to this boundary.
+    static constexpr std::size_t alignment{alignof(std::max_align_t)};
+
+private:
+    using unit_type = std::aligned_storage_t<alignment, alignment>;
+
+    static std::unique_ptr<unit_type[]> _units;
+    static std::size_t _capacity;
+    static std::size_t _used;
+
+public:
+    static void init(std::size_t capacity)
+    {
+        // Offsets must fit in 32 bits.
+        if(capacity > std::numeric_limits<std::uint32_t>::max())
+        {
+            throw std::length_error{"Arena capacity exceeds 4GB."};
+        }
+
+        _capacity = (capacity + alignment - 1) / alignment * alignment;
+        _units = std::make_unique<unit_type[]>(_capacity / alignment);
+
+        // Offset `0` is reserved to represent null.
+        _used = alignment;
+    }
+
+    static auto base() noexcept
+    {
+        return reinterpret_cast<std::byte*>(_units.get());
+    }
+
+    static auto used() noexcept
+    {
+        return _used;
+    }
+
+    // Returns the offset of uninitialized storage for a `T`. Throws
+    // `std::bad_alloc` if the arena is exhausted.
+    template <typename T>
+    static auto allocate()
+    {
+        using slot_type = std::aligned_storage_t<sizeof(T), alignof(T)>;
+
+        static_assert(alignof(slot_type) <= alignment, // .
+            "`T` is over-aligned for this arena.");
+
+        // Allocations are only padded to `T`'s own alignment, so that
+        // consecutive nodes are packed tightly.
+        auto offset(
+            (_used + alignof(slot_type) - 1) / alignof(slot_type) *
+            alignof(slot_type));
+
+        if(offset + sizeof(slot_type) > _capacity) throw std::bad_alloc{};
+        _used = offset + sizeof(slot_type);
+
+        return static_cast<std::uint32_t>(offset);
+    }
+
+    template <typename T>
+    static auto at(std::uint32_t offset) noexcept
+    {
+        using slot_type = std::aligned_storage_t<sizeof(T), alignof(T)>;
+        return storage_cast<T>(reinterpret_cast<slot_type*>(base() + offset));
+    }
+};
+
+template <typename TTag>
+std::unique_ptr<typename arena<TTag>::unit_type[]> arena<TTag>::_units;
+
+template <typename TTag>
+std::size_t arena<TTag>::_capacity{0};
+
+template <typename TTag>
+std::size_t arena<TTag>::_used{0};
+
+template <typename T, typename TArena>
+class offset_ptr
+{
+private:
+    std::uint32_t _offset{0};
+
+    explicit offset_ptr(std::uint32_t offset) noexcept : _offset{offset}
+    {
+    }
+
+public:
+    offset_ptr() = default;
+    offset_ptr(std::nullptr_t) noexcept
+    {
+    }
+
+    template <typename... Ts>
+    static auto make(Ts&&... xs)
+    {
+        auto offset(TArena::template allocate<T>());
+        new(TArena::template at<T>(offset)) T(std::forward<Ts>(xs)...);
+        return offset_ptr{offset};
+    }
+
+    auto get() const noexcept -> T*
+    {
+        // Offset `0` is null. This compiles to a conditional move, and
+        // `operator*`/`operator->` skip it entirely.
+        if(_offset == 0) return nullptr;
+        return reinterpret_cast<T*>(TArena::base() + _offset);
+    }
+
+    auto& operator*() const noexcept
+    {
+        assert(_offset != 0);
+        return *TArena::template at<T>(_offset);
+    }
+
+    auto operator-> () const noexcept
+    {
+        assert(_offset != 0);
+        return TArena::template at<T>(_offset);
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return _offset != 0;
+    }
+};
+
+static_assert(sizeof(offset_ptr<int, arena<void>>) == 4, "");
+
+// Benchmark: a perfectly balanced binary tree with 10M nodes, traversed
+// recursively. Both versions place their nodes in the same shuffled order
+// inside a contiguous buffer, so that the traversal actually misses the cache,
+// and the only difference between them is the node size.
+
+struct ptr_node
+{
+    int _value;
+    ptr_node* _left{nullptr};
+    ptr_node* _right{nullptr};
+};
+
+struct tree_arena_tag
+{
+};
+
+using tree_arena = arena<tree_arena_tag>;
+
+struct offset_node
+{
+    int _value;
+    offset_ptr<offset_node, tree_arena> _left;
+    offset_ptr<offset_node, tree_arena> _right;
+};
+
+static_assert(sizeof(ptr_node) == 24, "");
+static_assert(sizeof(offset_node) == 12, "");
+
+// `TSlots` maps the i-th created node to its (shuffled) storage slot.
+template <typename TPtr, typename TSlots>
+auto build_tree(TSlots& slots, std::size_t& next, int lo, int hi) -> TPtr
+{
+    if(lo >= hi) return nullptr;
+
+    auto mid(lo + (hi - lo) / 2);
+    TPtr result(slots[next++]);
+
+    result->_value = mid;
+    result->_left = build_tree<TPtr>(slots, next, lo, mid);
+    result->_right = build_tree<TPtr>(slots, next, mid + 1, hi);
+    return result;
+}
+
+template <typename TPtr>
+auto sum_tree(const TPtr& n) -> std::int64_t
+{
+    if(!n) return 0;
+    return n->_value + sum_tree(n->_left) + sum_tree(n->_right);
+}
+
+template <typename TF>
+auto time_ms(TF&& f)
+{
+    auto start(std::chrono::high_resolution_clock::now());
+    f();
+    auto end(std::chrono::high_resolution_clock::now());
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main()
+{
+    // Basic usage:
+    {
+        struct tag
+        {
+        };
+
+        using a = arena<tag>;
+        a::init(1024);
+
+        auto p0(offset_ptr<int, a>::make(10));
+        auto p1(offset_ptr<double, a>::make(20.0));
+        offset_ptr<int, a> p2;
+
+        assert(*p0 == 10 && *p1 == 20.0);
+        assert(!p2 && p2.get() == nullptr);
+
+        // Exhausting the arena throws, even with `NDEBUG` defined.
+        auto exhausted(false);
+        try
+        {
+            while(true) offset_ptr<double, a>::make(0.0);
+        }
+        catch(const std::bad_alloc&)
+        {
+            exhausted = true;
+        }
+
+        assert(exhausted && a::used() <= 1024);
+        (void)exhausted;
+
+        // Run-time assertion:
+        // *p2;
+    }
+
+    // 10M-node tree traversal.
+    // (Compile with optimizations enabled to get meaningful numbers.)
+    {
+        constexpr int n{10000000};
+
+        std::minstd_rand rng{1234};
+
+        std::vector<ptr_node> nodes(n);
+        std::vector<ptr_node*> ptr_slots;
+        for(auto& x : nodes) ptr_slots.emplace_back(&x);
+        std::shuffle(ptr_slots.begin(), ptr_slots.end(), rng);
+
+        tree_arena::init(tree_arena::alignment + n * sizeof(offset_node));
+        std::vector<offset_ptr<offset_node, tree_arena>> offset_slots;
+        for(int i{0}; i < n; ++i)
+        {
+            offset_slots.emplace_back(
+                offset_ptr<offset_node, tree_arena>::make());
+        }
+        std::shuffle(offset_slots.begin(), offset_slots.end(), rng);
+
+        std::size_t next{0};
+        auto ptr_root(build_tree<ptr_node*>(ptr_slots, next, 0, n));
+
+        next = 0;
+        auto offset_root(build_tree<offset_ptr<offset_node, tree_arena>>(
+            offset_slots, next, 0, n));
+
+        std::int64_t ptr_sum{0}, offset_sum{0};
+        auto ptr_ms(time_ms([&]
+            {
+                ptr_sum = sum_tree(ptr_root);
+            }));
+        auto offset_ms(time_ms([&]
+            {
+                offset_sum = sum_tree(offset_root);
+            }));
+
+        assert(ptr_sum == offset_sum);
+
+        std::cout << "raw pointers: " << n * sizeof(ptr_node) / (1024 * 1024)
+                  << "MB, " << ptr_ms << "ms\n"
+                  << "offset_ptr: " << tree_arena::used() / (1024 * 1024)
+                  << "MB, " << offset_ms << "ms\n";
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,276 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include "will_overflow.hpp"
+
+template <typename TOut, typename TIn>
+constexpr auto to_num(const TIn& x) noexcept
+{
+    static_assert(std::is_arithmetic<TOut>{}, // .
+        "Output type `TOut` must be arithmetic.");
+
+    static_assert(std::is_arithmetic<TIn>{}, // .
+        "Input type `TIn` must be arithmetic.");
+
+    assert((!impl::will_overflow<TOut, TIn>(x)));
+    return static_cast<TOut>(x);
+}
+
+// `num_to_void_ptr` stuffs a number into a pointer, only checking that it
+// fits. Let's look at the opposite, and much more useful, direction: stuffing
+// small numbers into the unused bits of a real pointer.
+
+// A pointer to a `T` is always a multiple of `alignof(T)`, so its lowest
+// `log2(alignof(T))` bits are always zero. Lock-free data structures use them
+// for version counters and "marked" flags, and compact tree nodes use them for
+// colors or balance factors, without spending an extra word per node.
+
+// The number of free bits can be computed at compile-time.
+
+namespace impl
+{
+    constexpr std::size_t log2(std::size_t x) noexcept
+    {
+        return x <= 1 ? 0 : 1 + log2(x / 2);
+    }
+}
+
+template <typename T>
+constexpr std::size_t free_low_bits{impl::log2(alignof(T))};
+
+static_assert(free_low_bits<char> == 0, "");
+static_assert(free_low_bits<std::int32_t> == 2, "");
+static_assert(free_low_bits<std::int64_t> == 3, "");
+
+template <typename T, std::size_t TBits = free_low_bits<T>>
+class tagged_ptr
+{
+public:
+    static constexpr std::uintptr_t max_tag{
+        (std::uintptr_t{1} << TBits) - 1};
+
+private:
+    static constexpr std::uintptr_t tag_mask{max_tag};
+    static constexpr std::uintptr_t ptr_mask{~tag_mask};
+
+    std::uintptr_t _data{0};
+
+    static auto to_bits(T* ptr) noexcept
+    {
+        // Requesting more bits than the alignment allows is a compile-time
+        // error. (The check lives here rather than at class scope, as `T` is
+        // often still incomplete there - think of a node pointing to its
+        // parent.)
+        static_assert(TBits <= free_low_bits<T>, // .
+            "`T`'s alignment does not leave `TBits` free bits.");
+
+        auto result(reinterpret_cast<std::uintptr_t>(ptr));
+
+        // Sanity check: a misaligned pointer would corrupt the tag.
+        assert((result & tag_mask) == 0);
+
+        return result;
+    }
+
+    // Tags are checked twice at run-time: `to_num` catches negative or
+    // otherwise unrepresentable values, and the range check catches values
+    // that don't fit in `TBits` bits.
+
+    // An out of range tag would be OR'ed into the pointer bits, corrupting the
+    // pointer: the range check is performed even with `NDEBUG` defined. (It
+    // also catches negative values, which convert to huge unsigned ones.)
+    template <typename TTag>
+    static auto checked_tag(const TTag& x) noexcept
+    {
+        auto result(to_num<std::uintptr_t>(x));
+        if(result > max_tag)
+        {
+            std::cerr << "tagged_ptr: tag does not fit in `TBits` bits\n";
+            std::abort();
+        }
+
+        return result;
+    }
+
+public:
+    tagged_ptr() = default;
+
+    tagged_ptr(T* ptr) noexcept : _data{to_bits(ptr)}
+    {
+    }
+
+    template <typename TTag>
+    tagged_ptr(T* ptr, const TTag& tag) noexcept
+        : _data{to_bits(ptr) | checked_tag(tag)}
+    {
+    }
+
+    auto ptr() const noexcept
+    {
+        return reinterpret_cast<T*>(_data & ptr_mask);
+    }
+
+    auto tag() const noexcept
+    {
+        return _data & tag_mask;
+    }
+
+    void set_ptr(T* ptr) noexcept
+    {
+        _data = to_bits(ptr) | tag();
+    }
+
+    template <typename TTag>
+    void set_tag(const TTag& x) noexcept
+    {
+        _data = (_data & ptr_mask) | checked_tag(x);
+    }
+
+    // When the tag is known at compile-time, it's checked at compile-time.
+    template <std::uintptr_t TTag>
+    void set_tag() noexcept
+    {
+        static_assert(TTag <= max_tag, // .
+            "Tag `TTag` does not fit in `TBits` bits.");
+
+        _data = (_data & ptr_mask) | TTag;
+    }
+
+    auto& operator*() const noexcept
+    {
+        assert(ptr() != nullptr);
+        return *ptr();
+    }
+
+    auto operator-> () const noexcept
+    {
+        assert(ptr() != nullptr);
+        return ptr();
+    }
+
+    friend bool operator==(const tagged_ptr& a, const tagged_ptr& b) noexcept
+    {
+        return a._data == b._data;
+    }
+
+    friend bool operator!=(const tagged_ptr& a, const tagged_ptr& b) noexcept
+    {
+        return !(a == b);
+    }
+};
+
+// A tagged pointer is exactly one word, and trivially copyable: it can be
+// used inside `std::atomic` and compared-and-swapped in a single instruction.
+
+static_assert(sizeof(tagged_ptr<std::int64_t>) == sizeof(void*), "");
+static_assert(std::is_trivially_copyable<tagged_ptr<std::int64_t>>{}, "");
+
+// Example: a red-black tree node storing its color in the parent pointer.
+
+struct rb_node
+{
+    static constexpr std::uintptr_t red{0};
+    static constexpr std::uintptr_t black{1};
+
+    int _value;
+    tagged_ptr<rb_node, 1> _parent;
+    rb_node* _left{nullptr};
+    rb_node* _right{nullptr};
+
+    auto color() const noexcept
+    {
+        return _parent.tag();
+    }
+};
+
+static_assert(sizeof(rb_node) == 4 * sizeof(void*), "");
+
+// Example: a lock-free stack head, using the free bits as an ABA counter.
+
+struct alignas(16) stack_node
+{
+    int _value;
+    stack_node* _next;
+};
+
+using stack_head = tagged_ptr<stack_node>;
+
+int main()
+{
+    // Basic usage:
+    {
+        std::int64_t x{10};
+        tagged_ptr<std::int64_t> p{&x, 5};
+
+        assert(p.ptr() == &x && *p == 10);
+        assert(p.tag() == 5);
+
+        p.set_tag(7);
+        assert(p.ptr() == &x && p.tag() == 7);
+
+        p.set_tag<3>();
+        assert(p.tag() == 3);
+
+        // Aborts at run-time, even with `NDEBUG` defined:
+        /*
+            p.set_tag(8);
+            p.set_tag(-1);
+            tagged_ptr<std::int64_t> p2{&x, 8};
+        */
+
+        // Compile-time assertion:
+        /*
+            p.set_tag<8>();
+        */
+    }
+
+    // Does not compile, as intended:
+    /*
+        char c;
+        tagged_ptr<char, 1> p0{&c};
+
+        std::int32_t i;
+        tagged_ptr<std::int32_t, 3> p1{&i};
+    */
+
+    // Tree node colors:
+    {
+        rb_node root{0};
+        rb_node child{1, {&root, rb_node::red}};
+
+        assert(child._parent.ptr() == &root);
+        assert(child.color() == rb_node::red);
+
+        child._parent.set_tag<rb_node::black>();
+        assert(child._parent.ptr() == &root);
+        assert(child.color() == rb_node::black);
+    }
+
+    // ABA-counted atomic head:
+    {
+        stack_node n0{0, nullptr}, n1{1, &n0};
+        std::atomic<stack_head> head{stack_head{&n0}};
+
+        // Every successful CAS bumps the counter (modulo 16), so a head that
+        // was popped and pushed back in the meantime is not mistaken for the
+        // old one.
+        auto old_head(head.load());
+        stack_head new_head{
+            &n1, (old_head.tag() + 1) % (stack_head::max_tag + 1)};
+
+        const bool swapped{head.compare_exchange_strong(old_head, new_head)};
+        assert(swapped && head.load().ptr() == &n1);
+        assert(head.load().tag() == 1);
+        (void)swapped;
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,323 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include "qualifier_utils.hpp"
+
+template <typename T>
+constexpr auto num_to_void_ptr(const T& x) noexcept
+    -> std::enable_if_t<!std::is_pointer<T>{}, // .
+        copy_cv_qualifiers<void, T>*>
+{
+    static_assert(sizeof(void*) >= sizeof(T), // .
+        "Input type `T` must fit into `void*.");
+
+    static_assert(std::is_arithmetic<std::decay_t<T>>{}, // .
+        "Input type `T` must be arithmethic.");
+
+    return reinterpret_cast<copy_cv_qualifiers<void*, T>>(x);
+}
+
+// To get numbers back out of a `void*`, we need the inverse cast, with the
+// same checks.
+template <typename TOut, typename T>
+constexpr auto void_ptr_to_num(T* x) noexcept
+    -> std::enable_if_t<std::is_void<T>{}, TOut>
+{
+    static_assert(sizeof(void*) >= sizeof(TOut), // .
+        "Output type `TOut` must fit into `void*.");
+
+    static_assert(std::is_integral<TOut>{}, // .
+        "Output type `TOut` must be integral.");
+
+    return static_cast<TOut>(reinterpret_cast<std::uintptr_t>(x));
+}
+
+// C callbacks and GPU-style APIs often let us attach a `void*` to an object.
+// Passing raw object addresses through them is dangerous: when the object
+// dies, the API still holds a dangling pointer.
+
+// A "slot map" solves this by handing out "generational handles": an index
+// into a table of slots, plus the generation of the slot at the time the
+// handle was issued. Destroying an object bumps its slot's generation, so that
+// stale handles fail to resolve instead of pointing to freed memory.
+
+// Objects are kept densely packed in a separate vector, so iterating over
+// all of them is as fast as iterating over a `std::vector`.
+
+struct handle
+{
+    std::uint32_t _index;
+    std::uint32_t _generation;
+};
+
+// Handles are 32+32 bits, which means that they fit into a `void*` on 64-bit
+// platforms.
+static_assert(sizeof(handle) == sizeof(std::uint64_t), "");
+
+auto to_void_ptr(const handle& h) noexcept
+{
+    return num_to_void_ptr(static_cast<std::uint64_t>(h._generation) << 32 |
+                           h._index);
+}
+
+auto handle_from_void_ptr(void* x) noexcept
+{
+    auto bits(void_ptr_to_num<std::uint64_t>(x));
+    return handle{static_cast<std::uint32_t>(bits),
+        static_cast<std::uint32_t>(bits >> 32)};
+}
+
+template <typename T>
+class slot_map
+{
+private:
+    struct slot
+    {
+        // When the slot is alive, the index of the object in `_data`.
+        // Otherwise, the index of the next free slot.
+        std::uint32_t _index;
+        std::uint32_t _generation;
+    };
+
+    static constexpr std::uint32_t null_index{0xFFFFFFFF};
+
+    // Generation `0` is never handed out: it's what a null `void*` decodes
+    // to, and it marks retired slots.
+    static constexpr std::uint32_t retired_generation{0};
+    static constexpr std::uint32_t max_generation{0xFFFFFFFF};
+
+    std::vector<T> _data;
+
+    // Maps every element of `_data` back to its slot, needed to keep `_data`
+    // dense on erasure.
+    std::vector<std::uint32_t> _data_to_slot;
+
+    std::vector<slot> _slots;
+    std::uint32_t _free_head{null_index};
+
+public:
+    template <typename... Ts>
+    auto emplace(Ts&&... xs)
+    {
+        std::uint32_t slot_index;
+
+        if(_free_head != null_index)
+        {
+            slot_index = _free_head;
+            _free_head = _slots[slot_index]._index;
+        }
+        else
+        {
+            // Generations start at `1`, so that a valid handle is never
+            // converted to a null `void*`.
+            slot_index = static_cast<std::uint32_t>(_slots.size());
+            _slots.push_back(slot{0, 1});
+        }
+
+        auto& s(_slots[slot_index]);
+        s._index = static_cast<std::uint32_t>(_data.size());
+
+        _data.emplace_back(std::forward<Ts>(xs)...);
+        _data_to_slot.push_back(slot_index);
+
+        return handle{slot_index, s._generation};
+    }
+
+    // One indexed load and a generation compare, plus a check that rejects
+    // the generation retired slots carry.
+    auto resolve(const handle& h) noexcept -> T*
+    {
+        if(h._index >= _slots.size()) return nullptr;
+        if(h._generation == retired_generation) return nullptr;
+
+        const auto& s(_slots[h._index]);
+        if(s._generation != h._generation) return nullptr;
+
+        return &_data[s._index];
+    }
+
+    auto resolve(void* x) noexcept
+    {
+        return resolve(handle_from_void_ptr(x));
+    }
+
+    auto erase(const handle& h)
+    {
+        if(resolve(h) == nullptr) return false;
+
+        auto& s(_slots[h._index]);
+        auto data_index(s._index);
+
+        // Keep `_data` dense by moving the last element into the hole.
+        auto last_slot(_data_to_slot.back());
+        _data[data_index] = std::move(_data.back());
+        _data_to_slot[data_index] = last_slot;
+        _slots[last_slot]._index = data_index;
+
+        _data.pop_back();
+        _data_to_slot.pop_back();
+
+        // A slot whose generation would wrap around is retired for good:
+        // otherwise, it would eventually reissue the generations of old,
+        // stale handles. That only happens after 2^32 - 1 reuses.
+        if(s._generation == max_generation)
+        {
+            s._generation = retired_generation;
+            return true;
+        }
+
+        // Invalidate outstanding handles and recycle the slot.
+        ++s._generation;
+        s._index = _free_head;
+        _free_head = h._index;
+
+        return true;
+    }
+
+    auto size() const noexcept
+    {
+        return _data.size();
+    }
+
+    auto begin() noexcept
+    {
+        return _data.begin();
+    }
+
+    auto end() noexcept
+    {
+        return _data.end();
+    }
+};
+
+// Example: a C API storing a `void*` userdata next to a callback.
+
+struct c_api_registration
+{
+    void (*_callback)(void*);
+    void* _userdata;
+};
+
+struct entity
+{
+    int _hp;
+};
+
+slot_map<entity> entities;
+
+void on_damage(void* userdata)
+{
+    // A stale handle resolves to `nullptr` instead of freed memory.
+    if(auto e = entities.resolve(userdata))
+    {
+        e->_hp -= 10;
+    }
+}
+
+int main()
+{
+    // Basic usage:
+    {
+        slot_map<int> m;
+        auto h0(m.emplace(10));
+        auto h1(m.emplace(20));
+
+        assert(*m.resolve(h0) == 10 && *m.resolve(h1) == 20);
+
+        m.erase(h0);
+        assert(m.resolve(h0) == nullptr && *m.resolve(h1) == 20);
+
+        // The slot is reused, with a new generation.
+        auto h2(m.emplace(30));
+        assert(h2._index == h0._index && h2._generation != h0._generation);
+        assert(m.resolve(h0) == nullptr && *m.resolve(h2) == 30);
+
+        // Storage stays dense.
+        int sum{0};
+        for(auto x : m) sum += x;
+        assert(m.size() == 2 && sum == 50);
+
+        // A null `void*` never resolves, even though it decodes to a handle
+        // for slot `0`.
+        void* null_userdata{nullptr};
+        assert(m.resolve(null_userdata) == nullptr);
+        (void)null_userdata;
+    }
+
+    // Through a `void*` API:
+    {
+        auto h(entities.emplace(entity{100}));
+        c_api_registration r{&on_damage, to_void_ptr(h)};
+
+        assert(r._userdata != nullptr);
+
+        r._callback(r._userdata);
+        assert(entities.resolve(h)->_hp == 90);
+
+        // After the entity dies, the callback is harmless.
+        entities.erase(h);
+        r._callback(r._userdata);
+    }
+
+    // Resolve cost against `std::unordered_map<void*, T*>`.
+    // (Compile with optimizations enabled to get meaningful numbers.)
+    {
+        constexpr std::size_t n{100000};
+        constexpr std::size_t lookups{5000000};
+
+        slot_map<entity> sm;
+        std::vector<entity> objects(n, entity{1});
+        std::unordered_map<void*, entity*> um;
+
+        std::vector<void*> sm_keys, um_keys;
+        for(std::size_t i{0}; i < n; ++i)
+        {
+            sm_keys.push_back(to_void_ptr(sm.emplace(entity{1})));
+            um_keys.push_back(&objects[i]);
+            um[&objects[i]] = &objects[i];
+        }
+
+        std::minstd_rand rng{1234};
+        std::vector<std::size_t> order(lookups);
+        for(auto& x : order) x = rng() % n;
+
+        auto time_ms([](auto&& f)
+            {
+                auto start(std::chrono::high_resolution_clock::now());
+                auto result(f());
+                auto end(std::chrono::high_resolution_clock::now());
+
+                std::cout << std::chrono::duration<double, std::milli>(
+                                 end - start).count()
+                          << "ms (checksum " << result << ")\n";
+            });
+
+        std::cout << "slot_map: ";
+        time_ms([&]
+            {
+                int sum{0};
+                for(auto i : order) sum += sm.resolve(sm_keys[i])->_hp;
+                return sum;
+            });
+
+        std::cout << "unordered_map: ";
+        time_ms([&]
+            {
+                int sum{0};
+                for(auto i : order) sum += um.find(um_keys[i])->second->_hp;
+                return sum;
+            });
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,252 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "qualifier_utils.hpp"
+
+template <typename T, typename TStorage>
+constexpr decltype(auto) storage_cast(TStorage* storage) noexcept
+{
+    static_assert(sizeof(typename TStorage::type) >= sizeof(T), // .
+        "`TStorage` is not big enough for `T`.");
+
+    static_assert(alignof(typename TStorage::type) >= alignof(T), // .
+        "`TStorage` is not properly aligned for `T`.");
+
+    assert(storage != nullptr);
+
+    using return_type = copy_cv_qualifiers<T, TStorage>;
+    return reinterpret_cast<return_type*>(storage);
+}
+
+template <typename T>
+constexpr auto to_void_ptr(T* x) noexcept
+{
+    return static_cast<copy_cv_qualifiers<void*, T>>(x);
+}
+
+// C libraries usually accept callbacks as a function pointer plus a `void*`
+// "userdata" that is passed back to it. Wrapping a C++ callable usually means
+// heap-allocating a `std::function` and passing its address as userdata:
+// one allocation per registration and one extra indirection per call.
+
+// Instead, we can store the callable directly inside caller-owned aligned
+// storage, and generate a "trampoline": a non-capturing function, specific to
+// the callable's type, that converts the userdata back and invokes it.
+
+// The storage also remembers which type it contains, so that debug builds
+// catch recovering the callable as the wrong type at run-time.
+
+namespace impl
+{
+    // Every type gets a unique address, used as a cheap RTTI-free type id.
+    // `inline`, so that the address is the same in every translation unit.
+    template <typename T>
+    inline constexpr char type_tag{};
+}
+
+// The tag is stored in release builds as well: mixing translation units
+// compiled with and without `NDEBUG` must not change the layout.
+template <std::size_t TSize, std::size_t TAlign = alignof(std::max_align_t)>
+struct callback_storage
+{
+    std::aligned_storage_t<TSize, TAlign> _storage;
+    const void* _type_tag{nullptr};
+};
+
+// A function pointer and userdata pair, ready to be passed to a C API.
+template <typename... TArgs>
+struct trampoline
+{
+    void (*_fn)(void*, TArgs...);
+    void* _userdata;
+
+    void operator()(TArgs... xs) const
+    {
+        _fn(_userdata, xs...);
+    }
+};
+
+// Recovers the callable stored in the storage pointed to by `userdata`.
+template <typename TF, typename TCallbackStorage>
+auto& recover_callback(void* userdata) noexcept
+{
+    assert(userdata != nullptr);
+    auto cs(static_cast<TCallbackStorage*>(userdata));
+
+    // Type-checked in debug builds only.
+    assert(cs->_type_tag == &impl::type_tag<TF>);
+
+    return *storage_cast<TF>(&cs->_storage);
+}
+
+namespace impl
+{
+    template <typename TF, typename TCallbackStorage, typename... TArgs>
+    void invoke_callback(void* userdata, TArgs... xs)
+    {
+        recover_callback<TF, TCallbackStorage>(userdata)(xs...);
+    }
+}
+
+// `TArgs...` are the arguments passed by the C API after the userdata.
+template <typename... TArgs, typename TCallbackStorage, typename TF>
+auto make_trampoline(TCallbackStorage& cs, TF&& f)
+{
+    using callable_type = std::decay_t<TF>;
+
+    // `storage_cast` checks at compile-time that the callable fits.
+    new(storage_cast<callable_type>(&cs._storage))
+        callable_type(std::forward<TF>(f));
+
+    cs._type_tag = &impl::type_tag<callable_type>;
+
+    return trampoline<TArgs...>{
+        &impl::invoke_callback<callable_type, TCallbackStorage, TArgs...>,
+        to_void_ptr(&cs)};
+}
+
+// The caller owns the storage, and is responsible for destroying the
+// callable once the C API won't use it anymore.
+template <typename TF, typename TCallbackStorage>
+void destroy_callback(TCallbackStorage& cs) noexcept
+{
+    recover_callback<TF, TCallbackStorage>(&cs).~TF();
+    cs._type_tag = nullptr;
+}
+
+// A fake C API, storing a single callback.
+struct c_event_source
+{
+    void (*_callback)(void*, int){nullptr};
+    void* _userdata{nullptr};
+
+    void register_callback(void (*callback)(void*, int), void* userdata)
+    {
+        _callback = callback;
+        _userdata = userdata;
+    }
+
+    void fire(int x) const
+    {
+        _callback(_userdata, x);
+    }
+};
+
+// The `std::function` approach we're replacing.
+auto make_heap_callback(std::function<void(int)> f)
+{
+    return std::make_unique<std::function<void(int)>>(std::move(f));
+}
+
+void invoke_heap_callback(void* userdata, int x)
+{
+    (*static_cast<std::function<void(int)>*>(userdata))(x);
+}
+
+int main()
+{
+    // Basic usage:
+    {
+        int total{0};
+        callback_storage<sizeof(void*)> cs;
+
+        auto on_event([&total](int x)
+            {
+                total += x;
+            });
+
+        c_event_source source;
+        auto t(make_trampoline<int>(cs, on_event));
+        source.register_callback(t._fn, t._userdata);
+
+        source.fire(10);
+        source.fire(20);
+        assert(total == 30);
+
+        destroy_callback<decltype(on_event)>(cs);
+    }
+
+    // Compile-time assertion (the callable does not fit):
+    /*
+        int a, b;
+        callback_storage<sizeof(void*)> cs;
+        make_trampoline<int>(cs, [&a, &b](int){ });
+    */
+
+    // Run-time assertion in debug builds (wrong type recovered):
+    /*
+        callback_storage<sizeof(int)> cs;
+        auto t(make_trampoline<>(cs, []{ }));
+        recover_callback<int, decltype(cs)>(t._userdata);
+    */
+
+    // Registration and dispatch cost against a heap-allocated
+    // `std::function`. (Compile with optimizations enabled to get meaningful
+    // numbers.)
+    {
+        constexpr std::size_t n{1000000};
+        int total{0};
+
+        auto on_event([&total](int x)
+            {
+                total += x;
+            });
+
+        using storage_type = callback_storage<sizeof(on_event)>;
+
+        auto time_ms([](auto&& f)
+            {
+                auto start(std::chrono::high_resolution_clock::now());
+                f();
+                auto end(std::chrono::high_resolution_clock::now());
+                return std::chrono::duration<double, std::milli>(end - start)
+                    .count();
+            });
+
+        std::vector<c_event_source> sources(n);
+        std::vector<storage_type> storages(n);
+        std::vector<std::unique_ptr<std::function<void(int)>>> functions;
+        functions.reserve(n);
+
+        auto tr_ms(time_ms([&]
+            {
+                for(std::size_t i{0}; i < n; ++i)
+                {
+                    auto t(make_trampoline<int>(storages[i], on_event));
+                    sources[i].register_callback(t._fn, t._userdata);
+                }
+
+                for(const auto& s : sources) s.fire(1);
+            }));
+
+        auto fn_ms(time_ms([&]
+            {
+                for(std::size_t i{0}; i < n; ++i)
+                {
+                    functions.emplace_back(make_heap_callback(on_event));
+                    sources[i].register_callback(
+                        &invoke_heap_callback, to_void_ptr(functions[i].get()));
+                }
+
+                for(const auto& s : sources) s.fire(1);
+            }));
+
+        assert(total == 2 * n);
+
+        std::cout << "inline trampolines: " << tr_ms << "ms\n"
+                  << "heap std::function: " << fn_ms << "ms\n";
+
+        for(auto& s : storages) destroy_callback<decltype(on_event)>(s);
+    }
+
+    return 0;
+}
\ No newline at end of file
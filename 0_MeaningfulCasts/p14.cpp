@@ -0,0 +1,246 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "will_overflow.hpp"
+
+template <typename TOut, typename TIn>
+constexpr auto to_num(const TIn& x) noexcept
+{
+    static_assert(std::is_arithmetic<TOut>{}, // .
+        "Output type `TOut` must be arithmetic.");
+
+    static_assert(std::is_arithmetic<TIn>{}, // .
+        "Input type `TIn` must be arithmetic.");
+
+    assert((!impl::will_overflow<TOut, TIn>(x)));
+    return static_cast<TOut>(x);
+}
+
+// `storage_cast` checks the size and alignment of a storage type against `T`
+// at compile-time. When the "storage" is a byte buffer received from the
+// network, the same checks have to happen at run-time.
+
+// If a wire format consists of fixed-layout little-endian structs, and the
+// host is little-endian as well, a validated buffer can be read in place: no
+// field needs to be copied out.
+
+// Correct alignment cannot be guaranteed for received buffers, though. In
+// that case, we fall back to `memcpy`. (C++20's `std::bit_cast` would express
+// the same thing, but we're targeting C++14/17 here, and `memcpy` of a
+// trivially copyable type is what `bit_cast` does under the hood anyway.)
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "`record_view` assumes a little-endian host."
+#endif
+
+template <typename T>
+class record_view
+{
+    static_assert(std::is_trivially_copyable<T>{}, // .
+        "`T` must be trivially copyable.");
+
+    static_assert(std::is_standard_layout<T>{}, // .
+        "`T` must have a standard layout.");
+
+private:
+    const std::byte* _data{nullptr};
+    bool _aligned{false};
+
+public:
+    record_view() = default;
+
+    // Validation: an invalid view is returned if the buffer is too small.
+    record_view(const std::byte* data, std::size_t size) noexcept
+    {
+        if(data == nullptr || size < sizeof(T)) return;
+
+        _data = data;
+        _aligned = reinterpret_cast<std::uintptr_t>(data) % alignof(T) == 0;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return _data != nullptr;
+    }
+
+    auto aligned() const noexcept
+    {
+        return _aligned;
+    }
+
+    // Only valid for aligned views: returns a pointer into the buffer.
+    auto in_place() const noexcept
+    {
+        assert(_data != nullptr && _aligned);
+        return reinterpret_cast<const T*>(_data);
+    }
+
+    // Always valid: returns a copy of the record.
+    auto load() const noexcept
+    {
+        assert(_data != nullptr);
+
+        T result;
+        std::memcpy(&result, _data, sizeof(T));
+        return result;
+    }
+
+    // Reads a single field, in place when possible.
+    template <typename TField>
+    auto get(TField T::*member) const noexcept
+    {
+        assert(_data != nullptr);
+
+        if(_aligned) return in_place()->*member;
+
+        // Misaligned case: only the field itself is copied.
+        T dummy;
+        auto offset(reinterpret_cast<const std::byte*>(&(dummy.*member)) -
+                    reinterpret_cast<const std::byte*>(&dummy));
+
+        TField result;
+        std::memcpy(&result, _data + offset, sizeof(TField));
+        return result;
+    }
+
+    // Reads a numeric field, narrowing it with `to_num`.
+    template <typename TOut, typename TField>
+    auto get_as(TField T::*member) const noexcept
+    {
+        return to_num<TOut>(get(member));
+    }
+};
+
+// Example: a wire record. Its layout is checked at compile-time, so that a
+// careless change to the struct doesn't silently change the wire format.
+
+struct trade_record
+{
+    std::uint64_t _id;
+    std::int64_t _price;
+    std::uint32_t _quantity;
+    std::uint16_t _venue;
+    std::uint16_t _flags;
+};
+
+static_assert(sizeof(trade_record) == 24, "");
+static_assert(offsetof(trade_record, _quantity) == 16, "");
+
+int main()
+{
+    std::vector<std::byte> buffer(sizeof(trade_record) + 1);
+
+    trade_record r{1, -250, 300, 2, 0};
+    std::memcpy(buffer.data(), &r, sizeof(r));
+
+    // Aligned buffers are read in place:
+    {
+        record_view<trade_record> v{buffer.data(), buffer.size()};
+        assert(v && v.aligned());
+
+        assert(v.in_place()->_price == -250);
+        assert(v.get(&trade_record::_quantity) == 300);
+        assert(v.get_as<std::uint8_t>(&trade_record::_venue) == 2);
+
+        // Run-time assertion:
+        /*
+            v.get_as<std::uint8_t>(&trade_record::_quantity);
+            v.get_as<std::uint64_t>(&trade_record::_price);
+        */
+    }
+
+    // Misaligned buffers fall back to `memcpy`:
+    {
+        std::memmove(buffer.data() + 1, buffer.data(), sizeof(r));
+
+        record_view<trade_record> v{buffer.data() + 1, buffer.size() - 1};
+        assert(v && !v.aligned());
+
+        assert(v.load()._id == 1);
+        assert(v.get(&trade_record::_price) == -250);
+    }
+
+    // Short buffers are rejected:
+    {
+        record_view<trade_record> v{buffer.data(), sizeof(trade_record) - 1};
+        assert(!v);
+    }
+
+    // Does not compile, as intended:
+    /*
+        record_view<std::vector<int>> v;
+    */
+
+    // Summing a field over a million records, copying every field out vs
+    // reading in place. (Compile with optimizations enabled to get meaningful
+    // numbers.)
+    {
+        constexpr std::size_t n{1000000};
+
+        std::vector<trade_record> records(n, r);
+        auto bytes(reinterpret_cast<const std::byte*>(records.data()));
+
+        auto time_ms([](auto&& f)
+            {
+                auto start(std::chrono::high_resolution_clock::now());
+                auto result(f());
+                auto end(std::chrono::high_resolution_clock::now());
+
+                std::cout << std::chrono::duration<double, std::milli>(
+                                 end - start).count()
+                          << "ms (checksum " << result << ")\n";
+            });
+
+        std::cout << "memcpy every field: ";
+        time_ms([&]
+            {
+                std::int64_t sum{0};
+                for(std::size_t i{0}; i < n; ++i)
+                {
+                    auto p(bytes + i * sizeof(trade_record));
+
+                    trade_record t;
+                    std::memcpy(&t._id, p + offsetof(trade_record, _id), 8);
+                    std::memcpy(
+                        &t._price, p + offsetof(trade_record, _price), 8);
+                    std::memcpy(
+                        &t._quantity, p + offsetof(trade_record, _quantity), 4);
+                    std::memcpy(
+                        &t._venue, p + offsetof(trade_record, _venue), 2);
+                    std::memcpy(
+                        &t._flags, p + offsetof(trade_record, _flags), 2);
+
+                    sum += t._price * t._quantity;
+                }
+
+                return sum;
+            });
+
+        std::cout << "record_view: ";
+        time_ms([&]
+            {
+                std::int64_t sum{0};
+                for(std::size_t i{0}; i < n; ++i)
+                {
+                    record_view<trade_record> v{
+                        bytes + i * sizeof(trade_record), sizeof(trade_record)};
+
+                    auto t(v.in_place());
+                    sum += t->_price * t->_quantity;
+                }
+
+                return sum;
+            });
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,305 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <cstddef>
+#include <string>
+#include "qualifier_utils.hpp"
+
+// Compile with `-DSTORAGE_LIFETIME_CHECKS` to enable lifetime tracking.
+#ifdef STORAGE_LIFETIME_CHECKS
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+#endif
+
+// `storage_cast` catches size and alignment mistakes at compile-time, but the
+// most common bugs around placement new are lifetime bugs:
+//
+// * constructing an object twice in the same storage;
+// * using the storage before constructing an object in it;
+// * using the storage after destroying the object.
+
+// In pooled code, these are hard to find with the usual tools, as the memory
+// is never actually freed. We can add an opt-in build mode that keeps a side
+// table of per-slot lifetime states, checked on every access.
+
+// When `STORAGE_LIFETIME_CHECKS` is not defined, everything below compiles down
+// to plain casts, placement new and destructor calls. When it is, violations
+// are reported and abort the program, even with `NDEBUG` defined.
+
+namespace impl
+{
+#ifdef STORAGE_LIFETIME_CHECKS
+    enum class slot_state
+    {
+        unconstructed,
+        constructed,
+        destroyed
+    };
+
+    struct slot_info
+    {
+        slot_state _state;
+
+        // Unique per-type address, used to catch type confusion.
+        const void* _type;
+    };
+
+    inline void verify_lifetime(bool x, const char* what) noexcept
+    {
+        if(!x)
+        {
+            std::cerr << "storage lifetime violation: " << what << "\n";
+            std::abort();
+        }
+    }
+
+    // `inline`, so that the address is the same in every translation unit.
+    template <typename T>
+    inline constexpr char type_tag{};
+
+    // The table is global and shared between threads, as pools are often
+    // filled by one thread and drained by another. This is a debugging aid, so
+    // a single mutex is good enough.
+    class lifetime_table
+    {
+    private:
+        std::mutex _mutex;
+        std::unordered_map<const void*, slot_info> _slots;
+
+    public:
+        void track(const void* slot)
+        {
+            std::lock_guard<std::mutex> l{_mutex};
+            _slots[slot] = slot_info{slot_state::unconstructed, nullptr};
+        }
+
+        void untrack(const void* slot)
+        {
+            std::lock_guard<std::mutex> l{_mutex};
+            _slots.erase(slot);
+        }
+
+        template <typename T>
+        void on_access(const void* slot)
+        {
+            std::lock_guard<std::mutex> l{_mutex};
+
+            // Slots that were never registered cannot be checked.
+            auto it(_slots.find(slot));
+            if(it == _slots.end()) return;
+
+            verify_lifetime(it->second._state == slot_state::constructed,
+                "use before construction, or after destruction");
+
+            verify_lifetime(it->second._type == &type_tag<T>,
+                "access as a different type");
+        }
+
+        template <typename T>
+        void on_construct(const void* slot)
+        {
+            std::lock_guard<std::mutex> l{_mutex};
+
+            // Untracked storage (e.g. on the stack) is not inserted here: it
+            // would never be removed, and a later, unrelated object reusing
+            // the same address would trip the checks.
+            auto it(_slots.find(slot));
+            if(it == _slots.end()) return;
+
+            auto& info(it->second);
+
+            verify_lifetime(info._state != slot_state::constructed,
+                "double construction");
+
+            info = slot_info{slot_state::constructed, &type_tag<T>};
+        }
+
+        template <typename T>
+        void on_destroy(const void* slot)
+        {
+            std::lock_guard<std::mutex> l{_mutex};
+
+            auto it(_slots.find(slot));
+            if(it == _slots.end()) return;
+
+            verify_lifetime(it->second._state == slot_state::constructed,
+                "destruction of an unconstructed or destroyed object");
+
+            verify_lifetime(it->second._type == &type_tag<T>,
+                "destruction as a different type");
+
+            it->second._state = slot_state::destroyed;
+        }
+    };
+
+    inline auto& get_lifetime_table()
+    {
+        static lifetime_table result;
+        return result;
+    }
+#endif
+}
+
+template <typename T, typename TStorage>
+constexpr decltype(auto) storage_cast(TStorage* storage) noexcept
+{
+    static_assert(sizeof(typename TStorage::type) >= sizeof(T), // .
+        "`TStorage` is not big enough for `T`.");
+
+    static_assert(alignof(typename TStorage::type) >= alignof(T), // .
+        "`TStorage` is not properly aligned for `T`.");
+
+    assert(storage != nullptr);
+
+#ifdef STORAGE_LIFETIME_CHECKS
+    impl::get_lifetime_table().on_access<T>(storage);
+#endif
+
+    using return_type = copy_cv_qualifiers<T, TStorage>;
+    return reinterpret_cast<return_type*>(storage);
+}
+
+// Since `storage_cast` now checks that the storage contains a live object,
+// construction and destruction must go through dedicated functions, which
+// update the table and bypass the access check.
+
+// Only storage registered with `storage_track` is checked. Pools should
+// register their slots when they're created, and unregister them before the
+// memory goes away.
+template <typename TStorage>
+void storage_track(TStorage* storage) noexcept
+{
+#ifdef STORAGE_LIFETIME_CHECKS
+    impl::get_lifetime_table().track(storage);
+#else
+    (void)storage;
+#endif
+}
+
+template <typename TStorage>
+void storage_untrack(TStorage* storage) noexcept
+{
+#ifdef STORAGE_LIFETIME_CHECKS
+    impl::get_lifetime_table().untrack(storage);
+#else
+    (void)storage;
+#endif
+}
+
+template <typename T, typename TStorage, typename... Ts>
+auto storage_construct(TStorage* storage, Ts&&... xs)
+{
+    static_assert(sizeof(typename TStorage::type) >= sizeof(T), // .
+        "`TStorage` is not big enough for `T`.");
+
+    static_assert(alignof(typename TStorage::type) >= alignof(T), // .
+        "`TStorage` is not properly aligned for `T`.");
+
+#ifdef STORAGE_LIFETIME_CHECKS
+    impl::get_lifetime_table().on_construct<T>(storage);
+#endif
+
+    using return_type = copy_cv_qualifiers<T, TStorage>;
+    return new(reinterpret_cast<return_type*>(storage))
+        T(std::forward<Ts>(xs)...);
+}
+
+template <typename T, typename TStorage>
+void storage_destroy(TStorage* storage) noexcept
+{
+    auto ptr(storage_cast<T>(storage));
+
+#ifdef STORAGE_LIFETIME_CHECKS
+    impl::get_lifetime_table().on_destroy<T>(storage);
+#endif
+
+    ptr->~T();
+}
+
+// Example: a tiny fixed-size object pool.
+
+template <typename T, std::size_t TCapacity>
+class pool
+{
+private:
+    using storage_type = std::aligned_storage_t<sizeof(T), alignof(T)>;
+    storage_type _slots[TCapacity];
+
+public:
+    pool() noexcept
+    {
+        for(auto& s : _slots) storage_track(&s);
+    }
+
+    ~pool()
+    {
+        for(auto& s : _slots) storage_untrack(&s);
+    }
+
+    template <typename... Ts>
+    auto& construct(std::size_t i, Ts&&... xs)
+    {
+        return *storage_construct<T>(&_slots[i], std::forward<Ts>(xs)...);
+    }
+
+    void destroy(std::size_t i) noexcept
+    {
+        storage_destroy<T>(&_slots[i]);
+    }
+
+    auto& operator[](std::size_t i) noexcept
+    {
+        return *storage_cast<T>(&_slots[i]);
+    }
+};
+
+int main()
+{
+#ifdef STORAGE_LIFETIME_CHECKS
+    std::cout << "lifetime checks enabled\n";
+#endif
+
+    // Correct usage:
+    {
+        pool<std::string, 4> p;
+
+        p.construct(0, "hello");
+        assert(p[0] == "hello");
+
+        p.destroy(0);
+        p.construct(0, "world");
+        assert(p[0] == "world");
+
+        p.destroy(0);
+    }
+
+    // Abort at run-time with `-DSTORAGE_LIFETIME_CHECKS`, even with `NDEBUG`
+    // defined:
+    /*
+        pool<std::string, 4> p;
+
+        // Use before construction:
+        p[1].size();
+
+        // Double construction:
+        p.construct(1, "a");
+        p.construct(1, "b");
+
+        // Use after destruction:
+        p.destroy(1);
+        p[1].size();
+
+        // Type confusion:
+        std::aligned_storage_t<sizeof(int), alignof(int)> s;
+        storage_track(&s);
+        storage_construct<int>(&s, 10);
+        storage_cast<float>(&s);
+    */
+
+    return 0;
+}
\ No newline at end of file
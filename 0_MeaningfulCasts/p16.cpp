@@ -0,0 +1,381 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include "qualifier_utils.hpp"
+
+// `to_derived` validates polymorphic downcasts with `dynamic_cast`, which
+// walks the type graph at run-time (and, on some ABIs, compares type name
+// strings). It's too expensive to leave on in release builds, so bad
+// downcasts go unnoticed there.
+
+// LLVM solves this with an intrusive "kind" protocol: every object stores an
+// integer identifying its dynamic type, and IDs are assigned in pre-order over
+// the hierarchy. Every subtree then owns a contiguous range of IDs, and "is
+// `x` a `T`?" becomes one or two integer comparisons. (See LLVM's "How to set
+// up LLVM-style RTTI for your class hierarchy".)
+
+// Hierarchies opt in by defining `kind_first` and `kind_last` (the range of
+// their subtree) in every class, and a `kind()` member function in the root.
+
+// Static members are inherited, so a class that forgets its own range would
+// silently use its parent's, and accept any sibling. To catch that, every
+// class also names itself as `kind_class`: an inherited `kind_class` names the
+// parent instead.
+
+using kind_id = std::uint32_t;
+
+namespace impl
+{
+    template <typename...>
+    using void_t = void;
+
+    template <typename T, typename = void>
+    struct has_kind_range : std::false_type
+    {
+    };
+
+    template <typename T>
+    struct has_kind_range<T,
+        void_t<decltype(T::kind_first), decltype(T::kind_last)>>
+        : std::true_type
+    {
+    };
+
+    template <typename T, typename = void>
+    struct declares_kind_range : std::false_type
+    {
+    };
+
+    template <typename T>
+    struct declares_kind_range<T, void_t<typename T::kind_class>>
+        : std::is_same<typename T::kind_class, T>
+    {
+    };
+
+    // Unlike an assertion, this check is cheap enough to stay enabled in
+    // release builds.
+    inline void verify_downcast(bool x) noexcept
+    {
+        if(!x)
+        {
+            std::cerr << "invalid downcast\n";
+            std::abort();
+        }
+    }
+
+    // This overload will be called when the hierarchy uses kind tags.
+    template <typename TDerived, typename TOut, typename T, typename TPoly>
+    void check_downcast(T* ptr, std::true_type, TPoly) noexcept
+    {
+        static_assert(declares_kind_range<TDerived>{}, // .
+            "`TDerived` must declare its own `kind_first`, `kind_last` and "
+            "`kind_class`.");
+
+        const auto k(ptr->kind());
+        verify_downcast(k >= TDerived::kind_first && k <= TDerived::kind_last);
+    }
+
+    // This overload will be called when the hierarchy is polymorphic, but
+    // doesn't use kind tags.
+    template <typename, typename TOut, typename T>
+    void check_downcast(T* ptr, std::false_type, std::true_type) noexcept
+    {
+        assert(dynamic_cast<TOut>(ptr) == ptr);
+        (void)ptr;
+    }
+
+    // This overload will be called when the hierarchy is neither.
+    template <typename, typename, typename T>
+    constexpr void check_downcast(
+        T*, std::false_type, std::false_type) noexcept
+    {
+    }
+
+    template <typename TDerived, typename TBase, typename TOut, typename T>
+    constexpr decltype(auto) hierarchy_cast(T* ptr) noexcept
+    {
+        static_assert(std::is_base_of<TBase, TDerived>{}, // .
+            "`TBase` is not a base class of `TDerived`.");
+
+        // Sanity check.
+        assert(ptr != nullptr);
+
+        check_downcast<TDerived, TOut>(ptr, has_kind_range<TDerived>{},
+            std::is_polymorphic<TBase>{});
+
+        return static_cast<TOut>(ptr);
+    }
+}
+
+template <typename TDerived, typename TBase>
+constexpr decltype(auto) to_derived(TBase* base) noexcept
+{
+    using result_type = copy_cv_qualifiers<TDerived, TBase>*;
+    return impl::hierarchy_cast<TDerived, TBase, result_type>(base);
+}
+
+template <typename TBase, typename TDerived>
+constexpr decltype(auto) to_base(TDerived* derived) noexcept
+{
+    using result_type = copy_cv_qualifiers<TBase, TDerived>*;
+    return impl::hierarchy_cast<TDerived, TBase, result_type>(derived);
+}
+
+// Example: the shape hierarchy, with kind tags.
+//
+//  shape            [0, 3]
+//  |- circle        [1, 1]
+//  `- polygon       [2, 3]
+//     `- rectangle  [3, 3]
+
+struct shape
+{
+    static constexpr kind_id kind_first{0};
+    static constexpr kind_id kind_last{3};
+    using kind_class = shape;
+
+    const kind_id _kind;
+
+    shape(kind_id k) noexcept : _kind{k}
+    {
+    }
+
+    virtual ~shape()
+    {
+    }
+
+    auto kind() const noexcept
+    {
+        return _kind;
+    }
+
+    virtual void draw() = 0;
+};
+
+struct circle : shape
+{
+    static constexpr kind_id kind_first{1};
+    static constexpr kind_id kind_last{1};
+    using kind_class = circle;
+
+    circle() noexcept : shape{kind_first}
+    {
+    }
+
+    void draw() override
+    {
+        std::cout << "draw circle\n";
+    }
+};
+
+struct polygon : shape
+{
+    static constexpr kind_id kind_first{2};
+    static constexpr kind_id kind_last{3};
+    using kind_class = polygon;
+
+    using shape::shape;
+};
+
+struct rectangle : polygon
+{
+    static constexpr kind_id kind_first{3};
+    static constexpr kind_id kind_last{3};
+    using kind_class = rectangle;
+
+    rectangle() noexcept : polygon{kind_first}
+    {
+    }
+
+    void draw() override
+    {
+        std::cout << "draw rectangle\n";
+    }
+};
+
+// For benchmarking, let's generate a deep hierarchy (a chain of `depth`
+// classes) and a wide one (`width` siblings). Every class carries kind tags,
+// so that both checks can be compared on the very same objects.
+
+constexpr int depth{16};
+constexpr int width{16};
+
+struct deep_root
+{
+    static constexpr kind_id kind_first{0};
+    static constexpr kind_id kind_last{depth};
+    using kind_class = deep_root;
+
+    const kind_id _kind;
+
+    deep_root(kind_id k) noexcept : _kind{k}
+    {
+    }
+
+    virtual ~deep_root()
+    {
+    }
+
+    auto kind() const noexcept
+    {
+        return _kind;
+    }
+};
+
+template <int TI>
+struct deep : deep<TI - 1>
+{
+    static constexpr kind_id kind_first{TI};
+    static constexpr kind_id kind_last{depth};
+    using kind_class = deep;
+
+    deep(kind_id k = TI) noexcept : deep<TI - 1>{k}
+    {
+    }
+};
+
+// `deep<0>`'s subtree is the same as the root's, but it still needs its own
+// declarations.
+template <>
+struct deep<0> : deep_root
+{
+    static constexpr kind_id kind_first{0};
+    static constexpr kind_id kind_last{depth};
+    using kind_class = deep;
+
+    using deep_root::deep_root;
+};
+
+struct wide_root
+{
+    static constexpr kind_id kind_first{0};
+    static constexpr kind_id kind_last{width};
+    using kind_class = wide_root;
+
+    const kind_id _kind;
+
+    wide_root(kind_id k) noexcept : _kind{k}
+    {
+    }
+
+    virtual ~wide_root()
+    {
+    }
+
+    auto kind() const noexcept
+    {
+        return _kind;
+    }
+};
+
+template <int TI>
+struct wide : wide_root
+{
+    static constexpr kind_id kind_first{TI};
+    static constexpr kind_id kind_last{TI};
+    using kind_class = wide;
+
+    wide() noexcept : wide_root{TI}
+    {
+    }
+};
+
+// Both checks, always evaluated, regardless of `NDEBUG`.
+template <typename TDerived, typename TBase>
+auto check_with_dynamic_cast(TBase* ptr) noexcept
+{
+    return dynamic_cast<TDerived*>(ptr) != nullptr;
+}
+
+template <typename TDerived, typename TBase>
+auto check_with_kind(TBase* ptr) noexcept
+{
+    const auto k(ptr->kind());
+    return k >= TDerived::kind_first && k <= TDerived::kind_last;
+}
+
+template <typename TF>
+void benchmark(const char* name, TF&& f)
+{
+    constexpr int iterations{10000000};
+    int hits{0};
+
+    auto start(std::chrono::high_resolution_clock::now());
+    for(int i{0}; i < iterations; ++i) hits += f();
+    auto end(std::chrono::high_resolution_clock::now());
+
+    std::cout << name << ": "
+              << std::chrono::duration<double, std::milli>(end - start).count()
+              << "ms (" << hits << " hits)\n";
+}
+
+void shape_example()
+{
+    auto my_circle = std::make_unique<circle>();
+    auto my_rectangle = std::make_unique<rectangle>();
+
+    shape* b0{my_circle.get()};
+    to_derived<circle>(b0)->draw();
+
+    shape* b1{my_rectangle.get()};
+    to_derived<polygon>(b1);
+    to_derived<rectangle>(b1)->draw();
+
+    // Run-time error, even in release builds:
+    // to_derived<rectangle>(b0)->draw();
+    // to_derived<polygon>(b0);
+
+    // Does not compile, as intended (`square` would inherit `rectangle`'s
+    // range):
+    /*
+        struct square : rectangle { };
+        to_derived<square>(b1);
+    */
+}
+
+int main()
+{
+    shape_example();
+
+    // Checking a downcast from the root to the deepest class, and from the
+    // root of a wide hierarchy to its last sibling.
+    // (Compile with optimizations enabled to get meaningful numbers.)
+    {
+        std::unique_ptr<deep_root> d{std::make_unique<deep<depth>>()};
+        std::unique_ptr<wide_root> w{std::make_unique<wide<width>>()};
+
+        // `volatile` prevents the compiler from devirtualizing everything.
+        deep_root* volatile dp{d.get()};
+        wide_root* volatile wp{w.get()};
+
+        benchmark("deep, dynamic_cast", [&dp]
+            {
+                return check_with_dynamic_cast<deep<depth>>(dp);
+            });
+
+        benchmark("deep, kind tags", [&dp]
+            {
+                return check_with_kind<deep<depth>>(dp);
+            });
+
+        benchmark("wide, dynamic_cast", [&wp]
+            {
+                return check_with_dynamic_cast<wide<width>>(wp);
+            });
+
+        benchmark("wide, kind tags", [&wp]
+            {
+                return check_with_kind<wide<width>>(wp);
+            });
+    }
+
+    return 0;
+}
\ No newline at end of file
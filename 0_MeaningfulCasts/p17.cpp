@@ -0,0 +1,262 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <typeinfo>
+#include "qualifier_utils.hpp"
+
+// `dynamic_cast` answers a very general question: "does the object pointed to
+// by `ptr` contain a `TDerived` subobject, anywhere in its hierarchy?".
+
+// When `TDerived` is `final`, the question becomes much simpler: the only
+// valid dynamic type is `TDerived` itself. Comparing `typeid`s is enough, and
+// on Itanium ABIs it usually boils down to a pointer comparison.
+
+// For non-`final` classes, we can still avoid most `dynamic_cast` calls by
+// remembering, at every call site, the last virtual table pointer that was
+// successfully validated: objects with the same dynamic type share the same
+// virtual table pointer.
+
+// Upcasts need none of this: they're always valid, and `static_cast` is
+// enough.
+
+namespace impl
+{
+    // Reads the virtual table pointer of a polymorphic object. This is not
+    // portable C++, but every mainstream ABI stores it at offset zero.
+    template <typename T>
+    auto vptr_of(T* ptr) noexcept
+    {
+        static_assert(std::is_polymorphic<T>{}, // .
+            "`T` must be polymorphic.");
+
+        const void* result;
+        std::memcpy(&result, ptr, sizeof(result));
+        return result;
+    }
+
+    template <typename TOut, typename T>
+    auto check_with_dynamic_cast(T* ptr) noexcept
+    {
+        return dynamic_cast<TOut>(ptr) == ptr;
+    }
+
+    template <typename TOut, typename T>
+    auto check_with_typeid(T* ptr) noexcept
+    {
+        using derived_type = std::remove_cv_t<std::remove_pointer_t<TOut>>;
+        return typeid(*ptr) == typeid(derived_type);
+    }
+
+    // One cache per pair of types and `TCallSite`, and per thread, so that no
+    // synchronization is needed. Call sites that see different dynamic types
+    // can pass their own `TCallSite` instead of thrashing a shared cache.
+    template <typename TOut, typename TCallSite = void, typename T>
+    auto check_with_vptr_cache(T* ptr) noexcept
+    {
+        thread_local const void* cached_vptr{nullptr};
+
+        const auto vptr(vptr_of(ptr));
+        if(vptr == cached_vptr) return true;
+
+        // Cache miss: fall back to `dynamic_cast`, and remember the result.
+        if(!check_with_dynamic_cast<TOut>(ptr)) return false;
+
+        cached_vptr = vptr;
+        return true;
+    }
+
+    // This overload will be called for downcasts to a `final` class.
+    template <typename TOut, typename, typename T>
+    void assert_correct_polymorphic(
+        T* ptr, std::true_type, std::true_type) noexcept
+    {
+        assert(check_with_typeid<TOut>(ptr));
+        (void)ptr;
+    }
+
+    // This overload will be called for downcasts to a non-`final` class.
+    template <typename TOut, typename TCallSite, typename T>
+    void assert_correct_polymorphic(
+        T* ptr, std::true_type, std::false_type) noexcept
+    {
+        assert((check_with_vptr_cache<TOut, TCallSite>(ptr)));
+        (void)ptr;
+    }
+
+    // This overload will be called for upcasts, and when
+    // `std::is_polymorphic<TBase>` is `false`.
+    template <typename, typename, typename T, typename TFinal>
+    constexpr void assert_correct_polymorphic(
+        T*, std::false_type, TFinal) noexcept
+    {
+    }
+
+    template <typename TDerived, typename TBase, typename TOut,
+        typename TCallSite, typename T>
+    constexpr decltype(auto) hierarchy_cast(T* ptr) noexcept
+    {
+        static_assert(std::is_base_of<TBase, TDerived>{}, // .
+            "`TBase` is not a base class of `TDerived`.");
+
+        // Sanity check.
+        assert(ptr != nullptr);
+
+        using is_downcast = std::is_same<TDerived,
+            std::remove_cv_t<std::remove_pointer_t<TOut>>>;
+
+        using needs_check = std::integral_constant<bool,
+            is_downcast{} && std::is_polymorphic<TBase>{}>;
+
+        assert_correct_polymorphic<TOut, TCallSite>(
+            ptr, needs_check{}, std::is_final<TDerived>{});
+
+        return static_cast<TOut>(ptr);
+    }
+}
+
+// Pass a unique `TCallSite` type to give a call site its own cache.
+template <typename TDerived, typename TCallSite = void, typename TBase>
+constexpr decltype(auto) to_derived(TBase* base) noexcept
+{
+    using result_type = copy_cv_qualifiers<TDerived, TBase>*;
+    return impl::hierarchy_cast<TDerived, TBase, result_type, TCallSite>(
+        base);
+}
+
+template <typename TBase, typename TDerived>
+constexpr decltype(auto) to_base(TDerived* derived) noexcept
+{
+    using result_type = copy_cv_qualifiers<TBase, TDerived>*;
+    return impl::hierarchy_cast<TDerived, TBase, result_type, void>(derived);
+}
+
+// The shape hierarchy, where `circle` and `rectangle` are `final`, and
+// `square` derives from the non-`final` `polygon`.
+
+struct shape
+{
+    virtual ~shape()
+    {
+    }
+
+    virtual void draw() = 0;
+};
+
+struct rectangle final : shape
+{
+    void draw() override
+    {
+        std::cout << "draw rectangle\n";
+    }
+};
+
+struct circle final : shape
+{
+    void draw() override
+    {
+        std::cout << "draw circle\n";
+    }
+};
+
+struct polygon : shape
+{
+    void draw() override
+    {
+        std::cout << "draw polygon\n";
+    }
+};
+
+struct square : polygon
+{
+    void draw() override
+    {
+        std::cout << "draw square\n";
+    }
+};
+
+template <typename TF>
+void benchmark(const char* name, TF&& f)
+{
+    constexpr int iterations{10000000};
+    int hits{0};
+
+    auto start(std::chrono::high_resolution_clock::now());
+    for(int i{0}; i < iterations; ++i) hits += f();
+    auto end(std::chrono::high_resolution_clock::now());
+
+    std::cout << name << ": "
+              << std::chrono::duration<double, std::milli>(end - start).count()
+              << "ms (" << hits << " hits)\n";
+}
+
+void shape_example()
+{
+    auto my_circle = std::make_unique<circle>();
+    auto my_square = std::make_unique<square>();
+
+    shape* b0{my_circle.get()};
+    to_derived<circle>(b0)->draw();
+
+    shape* b1{my_square.get()};
+    to_derived<polygon>(b1)->draw();
+    to_derived<square>(b1)->draw();
+
+    // Upcasts are never checked, even from a `final` class:
+    assert(to_base<shape>(my_circle.get()) == b0);
+
+    // A call site with its own cache:
+    struct my_call_site
+    {
+    };
+
+    to_derived<polygon, my_call_site>(b1)->draw();
+
+    // Run-time assertion:
+    // to_derived<rectangle>(b0)->draw();
+    // to_derived<polygon>(b0)->draw();
+}
+
+int main()
+{
+    shape_example();
+
+    // Validating downcasts in the shape hierarchy.
+    // (Compile with optimizations enabled to get meaningful numbers.)
+    {
+        auto c(std::make_unique<circle>());
+        auto s(std::make_unique<square>());
+
+        // `volatile` prevents the compiler from devirtualizing everything.
+        shape* volatile cp{c.get()};
+        shape* volatile sp{s.get()};
+
+        benchmark("final, dynamic_cast", [&cp]
+            {
+                return impl::check_with_dynamic_cast<circle*>(cp);
+            });
+
+        benchmark("final, typeid", [&cp]
+            {
+                return impl::check_with_typeid<circle*>(cp);
+            });
+
+        benchmark("non-final, dynamic_cast", [&sp]
+            {
+                return impl::check_with_dynamic_cast<polygon*>(sp);
+            });
+
+        benchmark("non-final, vptr cache", [&sp]
+            {
+                return impl::check_with_vptr_cache<polygon*>(sp);
+            });
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,318 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "qualifier_utils.hpp"
+
+// With multiple and virtual inheritance, downcasting may require adjusting
+// the pointer by an offset that depends on the object's dynamic type. When
+// virtual bases are involved, `static_cast` cannot downcast at all, and
+// `dynamic_cast` is the only option.
+
+// However, the adjustment only depends on the dynamic type of the object (and
+// on which subobject we're starting from). Both are identified by the virtual
+// table pointer stored in the subobject.
+
+// We can therefore memoize `dynamic_cast`: every call site gets a small
+// direct-mapped cache from virtual table pointer to "offset, or failure". On
+// a hit, a cast costs one comparison and one addition. On a miss, we fall back
+// to `dynamic_cast` and fill the cache entry.
+
+// Caches are `thread_local`, so they need no synchronization.
+
+namespace impl
+{
+    template <typename T>
+    auto vptr_of(T* ptr) noexcept
+    {
+        static_assert(std::is_polymorphic<T>{}, // .
+            "`T` must be polymorphic.");
+
+        // Not portable C++, but every mainstream ABI stores the virtual table
+        // pointer at offset zero of every polymorphic subobject.
+        const void* result;
+        std::memcpy(&result, ptr, sizeof(result));
+        return result;
+    }
+
+    struct cast_cache_entry
+    {
+        const void* _vptr{nullptr};
+        std::ptrdiff_t _offset{0};
+        bool _valid{false};
+    };
+
+    // Hit-rate instrumentation.
+    struct cast_cache_stats
+    {
+        std::size_t _hits{0};
+        std::size_t _misses{0};
+
+        auto hit_rate() const noexcept
+        {
+            const auto total(_hits + _misses);
+            return total == 0 ? 0.0 : double(_hits) / total;
+        }
+    };
+
+    // Entries only store an offset, which depends on the target type: a call
+    // site tag shared by several casts must not share their caches.
+    template <typename TCallSite, typename TDerived, typename TBase>
+    struct cast_cache
+    {
+        // Small and power-of-two sized, so that lookup is a shift.
+        static constexpr std::size_t size_bits{3};
+        static constexpr std::size_t size{std::size_t{1} << size_bits};
+
+        static thread_local cast_cache_entry _entries[size];
+        static thread_local cast_cache_stats _stats;
+
+        static auto& entry_for(const void* vptr) noexcept
+        {
+            // Virtual tables of related classes are often laid out close to
+            // each other, so we use Fibonacci hashing to spread them out.
+            auto bits(static_cast<std::uint64_t>(
+                reinterpret_cast<std::uintptr_t>(vptr)));
+
+            return _entries[(bits * 0x9E3779B97F4A7C15ull) >> (64 - size_bits)];
+        }
+    };
+
+    template <typename TCallSite, typename TDerived, typename TBase>
+    thread_local cast_cache_entry cast_cache<TCallSite, TDerived,
+        TBase>::_entries[cast_cache<TCallSite, TDerived, TBase>::size];
+
+    template <typename TCallSite, typename TDerived, typename TBase>
+    thread_local cast_cache_stats
+        cast_cache<TCallSite, TDerived, TBase>::_stats;
+
+    template <typename TCallSite, typename TDerived, typename TBase>
+    using cast_cache_for = cast_cache<TCallSite, std::remove_cv_t<TDerived>,
+        std::remove_cv_t<TBase>>;
+}
+
+// Returns `nullptr` if `base` doesn't point to a `TDerived`, like
+// `dynamic_cast`. Pass a unique `TCallSite` type to give a call site its own
+// cache: by default, one cache is shared by each pair of types. Caches are
+// always per pair of types, even when a `TCallSite` is reused.
+template <typename TDerived, typename TCallSite = void, typename TBase>
+auto cached_dynamic_cast(TBase* base) noexcept
+{
+    static_assert(std::is_polymorphic<TBase>{}, // .
+        "`TBase` must be polymorphic.");
+
+    using result_type = copy_cv_qualifiers<TDerived, TBase>*;
+    using cache = impl::cast_cache_for<TCallSite, TDerived, TBase>;
+
+    // Sanity check.
+    assert(base != nullptr);
+
+    using byte_type = copy_cv_qualifiers<char, TBase>;
+    auto bytes(reinterpret_cast<byte_type*>(base));
+
+    const auto vptr(impl::vptr_of(base));
+    auto& e(cache::entry_for(vptr));
+
+    if(e._vptr == vptr)
+    {
+        ++cache::_stats._hits;
+        return e._valid ? reinterpret_cast<result_type>(bytes + e._offset)
+                        : nullptr;
+    }
+
+    ++cache::_stats._misses;
+
+    auto result(dynamic_cast<result_type>(base));
+    e._vptr = vptr;
+    e._valid = result != nullptr;
+    e._offset =
+        e._valid ? reinterpret_cast<byte_type*>(result) - bytes : 0;
+
+    return result;
+}
+
+template <typename TDerived, typename TCallSite = void, typename TBase>
+const auto& cached_cast_stats() noexcept
+{
+    return impl::cast_cache_for<TCallSite, TDerived, TBase>::_stats;
+}
+
+// The checked `to_derived` counterpart, which asserts on failure.
+template <typename TDerived, typename TCallSite = void, typename TBase>
+auto cached_to_derived(TBase* base) noexcept
+{
+    static_assert(std::is_base_of<TBase, TDerived>{}, // .
+        "`TBase` is not a base class of `TDerived`.");
+
+    auto result(cached_dynamic_cast<TDerived, TCallSite>(base));
+    assert(result != nullptr);
+
+    return result;
+}
+
+// Example: a plugin hierarchy with multiple and virtual inheritance.
+
+struct plugin
+{
+    int _id{0};
+
+    virtual ~plugin()
+    {
+    }
+};
+
+struct serializable
+{
+    virtual ~serializable()
+    {
+    }
+};
+
+struct audio_plugin : virtual plugin
+{
+    float _gain{1.f};
+};
+
+struct midi_plugin : virtual plugin
+{
+    int _channel{0};
+};
+
+struct synth : audio_plugin, midi_plugin, serializable
+{
+    int _voices{8};
+};
+
+struct sampler : audio_plugin, serializable
+{
+    int _samples{0};
+};
+
+struct sequencer : midi_plugin, serializable
+{
+    int _steps{16};
+};
+
+int main()
+{
+    // Basic usage:
+    {
+        synth s;
+        plugin* p{&s};
+        serializable* ser{&s};
+
+        // Does not compile, as intended (virtual base):
+        // static_cast<synth*>(p);
+
+        for(int i{0}; i < 2; ++i)
+        {
+            // Kept out of `assert`, so that the caches are exercised even
+            // with `NDEBUG` defined.
+            auto from_plugin(cached_to_derived<synth>(p));
+            auto from_serializable(cached_to_derived<synth>(ser));
+            auto not_a_sampler(cached_dynamic_cast<sampler>(ser));
+
+            assert(from_plugin == &s && from_serializable == &s);
+            assert(not_a_sampler == nullptr);
+            (void)from_plugin;
+            (void)from_serializable;
+            (void)not_a_sampler;
+        }
+
+        // The second iteration only hits the caches.
+        assert((cached_cast_stats<synth, void, plugin>()._hits == 1));
+        assert((cached_cast_stats<synth, void, serializable>()._hits == 1));
+
+        // Run-time assertion:
+        // cached_to_derived<sampler>(ser);
+
+        // Call sites can have their own cache:
+        struct my_call_site
+        {
+        };
+
+        cached_dynamic_cast<synth, my_call_site>(p);
+        assert((cached_cast_stats<synth, my_call_site, plugin>()._misses == 1));
+
+        // Reusing a tag for another target type doesn't reuse its offsets:
+        auto as_midi(cached_dynamic_cast<midi_plugin, my_call_site>(p));
+        assert(as_midi == static_cast<midi_plugin*>(&s));
+        assert((cached_cast_stats<midi_plugin, my_call_site, plugin>()
+                    ._misses == 1));
+        (void)as_midi;
+    }
+
+    // Casting a mix of plugins, through their virtual base.
+    // (Compile with optimizations enabled to get meaningful numbers.)
+    {
+        std::vector<std::unique_ptr<plugin>> plugins;
+        for(int i{0}; i < 1000; ++i)
+        {
+            switch(i % 3)
+            {
+                case 0:
+                    plugins.emplace_back(std::make_unique<synth>());
+                    break;
+                case 1:
+                    plugins.emplace_back(std::make_unique<sampler>());
+                    break;
+                case 2:
+                    plugins.emplace_back(std::make_unique<sequencer>());
+                    break;
+            }
+        }
+
+        auto run([&](const char* name, auto&& cast)
+            {
+                int found{0};
+
+                auto start(std::chrono::high_resolution_clock::now());
+                for(int r{0}; r < 10000; ++r)
+                {
+                    for(const auto& p : plugins)
+                    {
+                        if(auto a = cast(p.get())) found += a->_gain > 0.f;
+                    }
+                }
+                auto end(std::chrono::high_resolution_clock::now());
+
+                std::cout << name << ": "
+                          << std::chrono::duration<double, std::milli>(
+                                 end - start).count()
+                          << "ms (" << found << " found)\n";
+            });
+
+        struct benchmark_call_site
+        {
+        };
+
+        run("dynamic_cast", [](plugin* p)
+            {
+                return dynamic_cast<audio_plugin*>(p);
+            });
+
+        run("cached_dynamic_cast", [](plugin* p)
+            {
+                return cached_dynamic_cast<audio_plugin, benchmark_call_site>(
+                    p);
+            });
+
+        const auto& stats(
+            cached_cast_stats<audio_plugin, benchmark_call_site, plugin>());
+
+        std::cout << "hit rate: " << stats.hit_rate() * 100.0 << "% ("
+                  << stats._hits << " hits, " << stats._misses
+                  << " misses)\n";
+    }
+
+    return 0;
+}
\ No newline at end of file
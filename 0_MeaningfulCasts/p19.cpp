@@ -0,0 +1,373 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+#include "qualifier_utils.hpp"
+
+namespace impl
+{
+    template <typename TOut, typename T>
+    constexpr void assert_correct_polymorphic(T* ptr, std::true_type) noexcept
+    {
+        assert(dynamic_cast<TOut>(ptr) == ptr);
+        (void)ptr;
+    }
+
+    template <typename, typename T>
+    constexpr void assert_correct_polymorphic(T*, std::false_type) noexcept
+    {
+    }
+
+    template <typename TDerived, typename TBase, typename TOut, typename T>
+    constexpr decltype(auto) hierarchy_cast(T* ptr) noexcept
+    {
+        static_assert(std::is_base_of<TBase, TDerived>{}, // .
+            "`TBase` is not a base class of `TDerived`.");
+
+        assert(ptr != nullptr);
+
+        assert_correct_polymorphic<TOut>(ptr, std::is_polymorphic<TBase>{});
+        return static_cast<TOut>(ptr);
+    }
+}
+
+template <typename TDerived, typename TBase>
+constexpr decltype(auto) to_derived(TBase* base) noexcept
+{
+    using result_type = copy_cv_qualifiers<TDerived, TBase>*;
+    return impl::hierarchy_cast<TDerived, TBase, result_type>(base);
+}
+
+template <typename TBase, typename TDerived>
+constexpr decltype(auto) to_base(TDerived* derived) noexcept
+{
+    using result_type = copy_cv_qualifiers<TBase, TDerived>*;
+    return impl::hierarchy_cast<TDerived, TBase, result_type>(derived);
+}
+
+// A `std::vector<std::unique_ptr<shape>>` scatters its objects all over the
+// heap, and iterating over it calls `draw()` on a random sequence of dynamic
+// types, which defeats the branch predictor.
+
+// A "polymorphic collection" (see Joaquín M López Muñoz's
+// Boost.PolyCollection) instead stores every dynamic type in its own
+// contiguous segment. Iterating segment by segment means that:
+//
+// * memory is accessed linearly;
+//
+// * consecutive virtual calls always go to the same function, so they're
+//   perfectly predicted;
+//
+// * if the caller names the types it expects, every segment can be iterated
+//   as a `std::vector` of a concrete type, so calls are devirtualized.
+
+template <typename TBase>
+class poly_collection
+{
+    static_assert(std::is_polymorphic<TBase>{}, // .
+        "`TBase` must be polymorphic.");
+
+private:
+    // A non-owning, allocation-free reference to a callable taking `TBase&`.
+    struct base_visitor
+    {
+        void* _ctx;
+        void (*_fn)(void*, TBase&);
+    };
+
+    struct segment_base
+    {
+        virtual ~segment_base()
+        {
+        }
+
+        virtual std::size_t size() const noexcept = 0;
+        virtual void for_each(base_visitor v) = 0;
+    };
+
+    template <typename T>
+    struct segment : segment_base
+    {
+        std::vector<T> _data;
+
+        std::size_t size() const noexcept override
+        {
+            return _data.size();
+        }
+
+        void for_each(base_visitor v) override
+        {
+            for(auto& x : _data) v._fn(v._ctx, *to_base<TBase>(&x));
+        }
+    };
+
+    std::vector<std::unique_ptr<segment_base>> _segments;
+    std::unordered_map<std::type_index, segment_base*> _segment_map;
+
+    template <typename T>
+    auto find_segment() -> segment<T>*
+    {
+        auto it(_segment_map.find(typeid(T)));
+        if(it == _segment_map.end()) return nullptr;
+
+        // The segment was created for `typeid(T)`, so `static_cast` is safe.
+        return static_cast<segment<T>*>(it->second);
+    }
+
+    template <typename T>
+    auto& get_or_create_segment()
+    {
+        if(auto s = find_segment<T>()) return *s;
+
+        _segments.emplace_back(std::make_unique<segment<T>>());
+        auto s(static_cast<segment<T>*>(_segments.back().get()));
+        _segment_map[typeid(T)] = s;
+        return *s;
+    }
+
+public:
+    // Copies or moves `x` into the segment of its static type. The returned
+    // reference is only valid until the next insertion of the same type, as
+    // segments are `std::vector`s.
+    template <typename T>
+    auto& insert(T&& x)
+    {
+        using type = std::decay_t<T>;
+
+        static_assert(std::is_base_of<TBase, type>{}, // .
+            "`T` must derive from `TBase`.");
+
+        // Only the static type's part of `x` is stored: passing a reference
+        // to a more derived object would slice it.
+        assert(typeid(x) == typeid(type));
+
+        auto& data(get_or_create_segment<type>()._data);
+        data.emplace_back(std::forward<T>(x));
+        return data.back();
+    }
+
+    auto size() const noexcept
+    {
+        std::size_t result{0};
+        for(const auto& s : _segments) result += s->size();
+        return result;
+    }
+
+    // Iterates over all elements as `TBase&`, segment by segment.
+    template <typename TF>
+    void for_each(TF&& f)
+    {
+        base_visitor v{&f, [](void* ctx, TBase& x)
+            {
+                (*static_cast<std::remove_reference_t<TF>*>(ctx))(x);
+            }};
+
+        for(auto& s : _segments) s->for_each(v);
+    }
+
+    // Iterates over the segments of types `Ts...` with their concrete type,
+    // then over the remaining segments as `TBase&`.
+    template <typename... Ts, typename TF>
+    void for_each_restituted(TF&& f)
+    {
+        static_assert(sizeof...(Ts) > 0, "");
+
+        // Concrete segments.
+        using expander = int[];
+        (void)expander{(
+            [&](auto* s)
+            {
+                if(s != nullptr)
+                {
+                    for(auto& x : s->_data) f(x);
+                }
+            }(find_segment<Ts>()),
+            0)...};
+
+        // Remaining segments.
+        for(auto& s : _segments)
+        {
+            bool known{false};
+            (void)expander{(known |= (s.get() == find_segment<Ts>()), 0)...};
+            if(known) continue;
+
+            s->for_each(base_visitor{&f, [](void* ctx, TBase& x)
+                {
+                    (*static_cast<std::remove_reference_t<TF>*>(ctx))(x);
+                }});
+        }
+    }
+};
+
+// Example: the shape hierarchy, where drawing accumulates into a canvas.
+
+struct canvas
+{
+    double _ink{0};
+};
+
+struct shape
+{
+    virtual ~shape()
+    {
+    }
+
+    virtual void draw(canvas& c) const = 0;
+};
+
+struct rectangle final : shape
+{
+    float _w, _h;
+
+    rectangle(float w, float h) noexcept : _w{w}, _h{h}
+    {
+    }
+
+    void draw(canvas& c) const override
+    {
+        c._ink += _w * _h;
+    }
+};
+
+struct circle final : shape
+{
+    float _r;
+
+    circle(float r) noexcept : _r{r}
+    {
+    }
+
+    void draw(canvas& c) const override
+    {
+        c._ink += 3.14159f * _r * _r;
+    }
+};
+
+struct triangle final : shape
+{
+    float _b, _h;
+
+    triangle(float b, float h) noexcept : _b{b}, _h{h}
+    {
+    }
+
+    void draw(canvas& c) const override
+    {
+        c._ink += _b * _h * 0.5f;
+    }
+};
+
+int main()
+{
+    // Basic usage:
+    {
+        poly_collection<shape> pc;
+        pc.insert(circle{1.f});
+        pc.insert(rectangle{2.f, 3.f});
+        pc.insert(circle{2.f});
+
+        assert(pc.size() == 3);
+
+        // `to_derived` works on elements, as they're stored with their
+        // dynamic type.
+        int circles{0};
+        pc.for_each([&](shape& s)
+            {
+                if(dynamic_cast<circle*>(&s) == nullptr) return;
+
+                to_derived<circle>(&s)->_r += 1.f;
+                ++circles;
+            });
+
+        assert(circles == 2);
+
+        // Run-time assertion:
+        /*
+            pc.for_each([](shape& s){ to_derived<rectangle>(&s); });
+        */
+    }
+
+    // Drawing 10M mixed shapes.
+    // (Compile with optimizations enabled to get meaningful numbers.)
+    {
+        constexpr std::size_t n{10000000};
+
+        std::minstd_rand rng{1234};
+        std::vector<int> kinds(n);
+        for(auto& k : kinds) k = rng() % 3;
+
+        std::vector<std::unique_ptr<shape>> ptrs;
+        poly_collection<shape> pc;
+
+        for(auto k : kinds)
+        {
+            switch(k)
+            {
+                case 0:
+                    ptrs.emplace_back(std::make_unique<circle>(1.f));
+                    pc.insert(circle{1.f});
+                    break;
+                case 1:
+                    ptrs.emplace_back(std::make_unique<rectangle>(1.f, 2.f));
+                    pc.insert(rectangle{1.f, 2.f});
+                    break;
+                case 2:
+                    ptrs.emplace_back(std::make_unique<triangle>(1.f, 2.f));
+                    pc.insert(triangle{1.f, 2.f});
+                    break;
+            }
+        }
+
+        auto run([](const char* name, auto&& f)
+            {
+                canvas c;
+
+                auto start(std::chrono::high_resolution_clock::now());
+                f(c);
+                auto end(std::chrono::high_resolution_clock::now());
+
+                std::cout << name << ": "
+                          << std::chrono::duration<double, std::milli>(
+                                 end - start).count()
+                          << "ms (ink " << c._ink << ")\n";
+            });
+
+        run("vector<unique_ptr<shape>>", [&](canvas& c)
+            {
+                for(const auto& p : ptrs) p->draw(c);
+            });
+
+        run("poly_collection, virtual", [&](canvas& c)
+            {
+                pc.for_each([&c](const shape& s)
+                    {
+                        s.draw(c);
+                    });
+            });
+
+        run("poly_collection, restituted", [&](canvas& c)
+            {
+                // The generic lambda is instantiated for `circle&`,
+                // `rectangle&`, `triangle&` and `shape&`. The first three are
+                // `final`, so their `draw` calls are devirtualized.
+                pc.for_each_restituted<circle, rectangle, triangle>(
+                    [&c](const auto& s)
+                    {
+                        s.draw(c);
+                    });
+            });
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,355 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <vector>
+#include "qualifier_utils.hpp"
+
+template <typename T, typename TStorage>
+constexpr decltype(auto) storage_cast(TStorage* storage) noexcept
+{
+    static_assert(sizeof(typename TStorage::type) >= sizeof(T), // .
+        "`TStorage` is not big enough for `T`.");
+
+    static_assert(alignof(typename TStorage::type) >= alignof(T), // .
+        "`TStorage` is not properly aligned for `T`.");
+
+    assert(storage != nullptr);
+
+    using return_type = copy_cv_qualifiers<T, TStorage>;
+    return reinterpret_cast<return_type*>(storage);
+}
+
+// Inheritance forces reference semantics on us: shapes must be allocated
+// separately and handled through pointers, and every object carries a virtual
+// table pointer.
+
+// Type erasure gives us a value-semantic alternative (see Sean Parent's
+// "Inheritance Is The Base Class of Evil"). Concrete shapes are plain structs,
+// with no common base class. `any_shape` stores any of them inline, in aligned
+// storage, and dispatches through a static table of function pointers that we
+// build by hand, one per concrete type.
+
+struct canvas
+{
+    double _ink{0};
+};
+
+struct rectangle
+{
+    float _w, _h;
+
+    void draw(canvas& c) const noexcept
+    {
+        c._ink += _w * _h;
+    }
+};
+
+struct circle
+{
+    float _r;
+
+    void draw(canvas& c) const noexcept
+    {
+        c._ink += 3.14159f * _r * _r;
+    }
+};
+
+class any_shape
+{
+public:
+    // Big enough for our shapes. Shapes that don't fit are rejected at
+    // compile-time by `storage_cast`.
+    static constexpr std::size_t capacity{2 * sizeof(void*)};
+
+private:
+    using storage_type =
+        std::aligned_storage_t<capacity, alignof(std::max_align_t)>;
+
+    // The "manual virtual table".
+    struct vtable
+    {
+        void (*_draw)(const storage_type*, canvas&);
+        void (*_copy)(storage_type*, const storage_type*);
+        void (*_move)(storage_type*, storage_type*) noexcept;
+        void (*_destroy)(storage_type*) noexcept;
+    };
+
+    template <typename T>
+    static constexpr vtable vtable_for{
+        [](const storage_type* s, canvas& c)
+        {
+            storage_cast<T>(s)->draw(c);
+        },
+        [](storage_type* dst, const storage_type* src)
+        {
+            new(storage_cast<T>(dst)) T(*storage_cast<T>(src));
+        },
+        [](storage_type* dst, storage_type* src) noexcept
+        {
+            new(storage_cast<T>(dst)) T(std::move(*storage_cast<T>(src)));
+        },
+        [](storage_type* s) noexcept
+        {
+            storage_cast<T>(s)->~T();
+        }};
+
+    const vtable* _vtable;
+    storage_type _storage;
+
+public:
+    template <typename T, typename = std::enable_if_t< // .
+                              !std::is_same<std::decay_t<T>, any_shape>{}>>
+    any_shape(T&& x) : _vtable{&vtable_for<std::decay_t<T>>}
+    {
+        using type = std::decay_t<T>;
+
+        // Moving shapes around must not fail, so that `any_shape`'s own moves
+        // can be `noexcept`: `std::vector` copies elements on reallocation
+        // otherwise.
+        static_assert(std::is_nothrow_move_constructible<type>{}, // .
+            "Shapes must be nothrow move constructible.");
+
+        new(storage_cast<type>(&_storage)) type(std::forward<T>(x));
+    }
+
+    any_shape(const any_shape& rhs) : _vtable{rhs._vtable}
+    {
+        _vtable->_copy(&_storage, &rhs._storage);
+    }
+
+    any_shape(any_shape&& rhs) noexcept : _vtable{rhs._vtable}
+    {
+        _vtable->_move(&_storage, &rhs._storage);
+    }
+
+    // Copy-and-swap: if the copy throws, `*this` is left untouched.
+    any_shape& operator=(const any_shape& rhs)
+    {
+        any_shape temp(rhs);
+        swap(temp);
+        return *this;
+    }
+
+    any_shape& operator=(any_shape&& rhs) noexcept
+    {
+        if(this == &rhs) return *this;
+
+        _vtable->_destroy(&_storage);
+        _vtable = rhs._vtable;
+        _vtable->_move(&_storage, &rhs._storage);
+        return *this;
+    }
+
+    ~any_shape()
+    {
+        _vtable->_destroy(&_storage);
+    }
+
+    void swap(any_shape& rhs) noexcept
+    {
+        any_shape temp(std::move(rhs));
+        rhs = std::move(*this);
+        *this = std::move(temp);
+    }
+
+    void draw(canvas& c) const
+    {
+        _vtable->_draw(&_storage, c);
+    }
+
+    // Type-checked access to the concrete shape, the type-erased counterpart
+    // of `to_derived`.
+    template <typename T>
+    auto holds() const noexcept
+    {
+        return _vtable == &vtable_for<T>;
+    }
+
+    template <typename T>
+    auto& get() noexcept
+    {
+        assert(holds<T>());
+        return *storage_cast<T>(&_storage);
+    }
+};
+
+// `std::vector<any_shape>` moves, rather than copies, on reallocation:
+static_assert(std::is_nothrow_move_constructible<any_shape>{}, "");
+static_assert(std::is_nothrow_move_assignable<any_shape>{}, "");
+
+// The virtual hierarchy we're comparing against.
+
+namespace virt
+{
+    struct shape
+    {
+        virtual ~shape()
+        {
+        }
+
+        virtual void draw(canvas& c) const = 0;
+        virtual std::unique_ptr<shape> clone() const = 0;
+    };
+
+    struct rectangle : shape
+    {
+        float _w, _h;
+
+        rectangle(float w, float h) noexcept : _w{w}, _h{h}
+        {
+        }
+
+        void draw(canvas& c) const override
+        {
+            c._ink += _w * _h;
+        }
+
+        std::unique_ptr<shape> clone() const override
+        {
+            return std::make_unique<rectangle>(*this);
+        }
+    };
+
+    struct circle : shape
+    {
+        float _r;
+
+        circle(float r) noexcept : _r{r}
+        {
+        }
+
+        void draw(canvas& c) const override
+        {
+            c._ink += 3.14159f * _r * _r;
+        }
+
+        std::unique_ptr<shape> clone() const override
+        {
+            return std::make_unique<circle>(*this);
+        }
+    };
+}
+
+template <typename TF>
+auto time_ms(TF&& f)
+{
+    auto start(std::chrono::high_resolution_clock::now());
+    f();
+    auto end(std::chrono::high_resolution_clock::now());
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main()
+{
+    // Basic usage:
+    {
+        std::vector<any_shape> shapes;
+        shapes.emplace_back(circle{1.f});
+        shapes.emplace_back(rectangle{2.f, 3.f});
+
+        auto copy(shapes);
+
+        canvas c;
+        for(const auto& s : copy) s.draw(c);
+        assert(c._ink > 9.f);
+
+        assert(shapes[0].holds<circle>());
+        assert(shapes[1].get<rectangle>()._w == 2.f);
+
+        // Assignment changes the stored type.
+        shapes[0] = shapes[1];
+        assert(shapes[0].holds<rectangle>());
+
+        // Run-time assertion:
+        // shapes[0].get<rectangle>();
+    }
+
+    // Compile-time assertion (does not fit in the inline storage):
+    /*
+        struct big_shape
+        {
+            double _data[8];
+            void draw(canvas&) const { }
+        };
+
+        any_shape s{big_shape{}};
+    */
+
+    // Construction, copy and dispatch throughput.
+    // (Compile with optimizations enabled to get meaningful numbers.)
+    {
+        constexpr std::size_t n{1000000};
+
+        std::minstd_rand rng{1234};
+        std::vector<int> kinds(n);
+        for(auto& k : kinds) k = rng() % 2;
+
+        std::vector<any_shape> values;
+        std::vector<std::unique_ptr<virt::shape>> ptrs;
+        values.reserve(n);
+        ptrs.reserve(n);
+
+        auto v_construct(time_ms([&]
+            {
+                for(auto k : kinds)
+                {
+                    if(k == 0) ptrs.emplace_back(
+                        std::make_unique<virt::circle>(1.f));
+                    else ptrs.emplace_back(
+                        std::make_unique<virt::rectangle>(1.f, 2.f));
+                }
+            }));
+
+        auto a_construct(time_ms([&]
+            {
+                for(auto k : kinds)
+                {
+                    if(k == 0) values.emplace_back(circle{1.f});
+                    else values.emplace_back(rectangle{1.f, 2.f});
+                }
+            }));
+
+        std::vector<std::unique_ptr<virt::shape>> ptrs_copy;
+        ptrs_copy.reserve(n);
+
+        auto v_copy(time_ms([&]
+            {
+                for(const auto& p : ptrs) ptrs_copy.emplace_back(p->clone());
+            }));
+
+        std::vector<any_shape> values_copy;
+        auto a_copy(time_ms([&]
+            {
+                values_copy = values;
+            }));
+
+        canvas vc, ac;
+
+        auto v_draw(time_ms([&]
+            {
+                for(const auto& p : ptrs) p->draw(vc);
+            }));
+
+        auto a_draw(time_ms([&]
+            {
+                for(const auto& s : values) s.draw(ac);
+            }));
+
+        assert(vc._ink == ac._ink);
+
+        std::cout << "virtual hierarchy: construct " << v_construct
+                  << "ms, copy " << v_copy << "ms, draw " << v_draw << "ms\n"
+                  << "any_shape:         construct " << a_construct
+                  << "ms, copy " << a_copy << "ms, draw " << a_draw << "ms\n";
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,562 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "qualifier_utils.hpp"
+
+namespace impl
+{
+    template <typename TOut, typename T>
+    constexpr void assert_correct_polymorphic(T* ptr, std::true_type) noexcept
+    {
+        assert(dynamic_cast<TOut>(ptr) == ptr);
+        (void)ptr;
+    }
+
+    template <typename, typename T>
+    constexpr void assert_correct_polymorphic(T*, std::false_type) noexcept
+    {
+    }
+
+    template <typename TDerived, typename TBase, typename TOut, typename T>
+    constexpr decltype(auto) hierarchy_cast(T* ptr) noexcept
+    {
+        static_assert(std::is_base_of<TBase, TDerived>{}, // .
+            "`TBase` is not a base class of `TDerived`.");
+
+        assert(ptr != nullptr);
+
+        assert_correct_polymorphic<TOut>(ptr, std::is_polymorphic<TBase>{});
+        return static_cast<TOut>(ptr);
+    }
+}
+
+template <typename TDerived, typename TBase>
+constexpr decltype(auto) to_derived(TBase* base) noexcept
+{
+    using result_type = copy_cv_qualifiers<TDerived, TBase>*;
+    return impl::hierarchy_cast<TDerived, TBase, result_type>(base);
+}
+
+template <typename TBase, typename TDerived>
+constexpr decltype(auto) to_base(TDerived* derived) noexcept
+{
+    using result_type = copy_cv_qualifiers<TBase, TDerived>*;
+    return impl::hierarchy_cast<TDerived, TBase, result_type>(derived);
+}
+
+// Per-frame object graphs are usually built with one `std::make_unique` per
+// object, and torn down with one `delete` per object at the end of the frame.
+
+// An arena replaces both with pointer bumps:
+//
+// * objects are constructed in large blocks, one after the other;
+//
+// * destructors are recorded only for types that are not trivially
+//   destructible, and run in reverse construction order;
+//
+// * `reset()` runs the recorded destructors and rewinds the arena, keeping
+//   its blocks for the next frame.
+
+// Objects are always destroyed through their concrete type, so the base class
+// of an arena-allocated hierarchy doesn't need a virtual destructor. Without
+// it, leaf classes with trivial members are trivially destructible, and their
+// teardown costs nothing at all.
+
+class object_arena;
+
+// Move-only handle to an arena object. It doesn't own the object: the arena
+// does, and destroys it when reset, not when the handle goes out of scope.
+// Like a `unique_ptr`, it has a single holder at a time. In debug builds,
+// handles remember the arena "epoch" they were created in, and using them
+// after a reset is a run-time assertion.
+template <typename T>
+class arena_ptr
+{
+    template <typename>
+    friend class arena_ptr;
+
+    friend class object_arena;
+
+private:
+    T* _ptr{nullptr};
+
+#ifndef NDEBUG
+    const object_arena* _arena{nullptr};
+    std::size_t _epoch{0};
+#endif
+
+    void assert_alive() const noexcept;
+
+    arena_ptr(T* ptr, const object_arena& a) noexcept;
+
+public:
+    arena_ptr() = default;
+
+    arena_ptr(const arena_ptr&) = delete;
+    arena_ptr& operator=(const arena_ptr&) = delete;
+
+    arena_ptr(arena_ptr&& rhs) noexcept
+    {
+        *this = std::move(rhs);
+    }
+
+    // Upcasts go through `to_base`.
+    template <typename TDerived,
+        typename = std::enable_if_t<std::is_base_of<T, TDerived>{}>>
+    arena_ptr(arena_ptr<TDerived>&& rhs) noexcept
+    {
+        if(rhs._ptr != nullptr) _ptr = to_base<T>(rhs._ptr);
+
+#ifndef NDEBUG
+        _arena = rhs._arena;
+        _epoch = rhs._epoch;
+#endif
+
+        rhs._ptr = nullptr;
+    }
+
+    arena_ptr& operator=(arena_ptr&& rhs) noexcept
+    {
+        std::swap(_ptr, rhs._ptr);
+
+#ifndef NDEBUG
+        std::swap(_arena, rhs._arena);
+        std::swap(_epoch, rhs._epoch);
+#endif
+
+        return *this;
+    }
+
+    auto get() const noexcept
+    {
+        if(_ptr != nullptr) assert_alive();
+        return _ptr;
+    }
+
+    auto& operator*() const noexcept
+    {
+        assert(_ptr != nullptr);
+        return *get();
+    }
+
+    auto operator-> () const noexcept
+    {
+        assert(_ptr != nullptr);
+        return get();
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return _ptr != nullptr;
+    }
+};
+
+class object_arena
+{
+private:
+    struct block
+    {
+        std::unique_ptr<std::byte[]> _data;
+        std::size_t _size;
+    };
+
+    struct destructor_entry
+    {
+        void* _ptr;
+        void (*_destroy)(void*);
+    };
+
+    std::size_t _block_size;
+    std::vector<block> _blocks;
+    std::vector<destructor_entry> _destructors;
+
+    // Index of the block we're currently allocating from.
+    std::size_t _current{0};
+    std::size_t _used{0};
+
+    // Incremented by every reset, to detect dangling handles.
+    std::size_t _epoch{0};
+
+    void next_block(std::size_t min_size)
+    {
+        // Reuse blocks left over from a previous frame, if big enough.
+        while(++_current < _blocks.size())
+        {
+            if(_blocks[_current]._size >= min_size)
+            {
+                _used = 0;
+                return;
+            }
+        }
+
+        const auto size(std::max(_block_size, min_size));
+        _blocks.push_back(block{std::make_unique<std::byte[]>(size), size});
+        _current = _blocks.size() - 1;
+        _used = 0;
+    }
+
+    // `alignment` is checked at compile-time by `make`.
+    auto allocate(std::size_t size, std::size_t alignment)
+    {
+        auto aligned_used([&]
+            {
+                return (_used + alignment - 1) / alignment * alignment;
+            });
+
+        if(_blocks.empty() || aligned_used() + size > _blocks[_current]._size)
+        {
+            next_block(size);
+        }
+
+        auto offset(aligned_used());
+        _used = offset + size;
+
+        return _blocks[_current]._data.get() + offset;
+    }
+
+public:
+    explicit object_arena(std::size_t block_size = 64 * 1024)
+        : _block_size{block_size}
+    {
+    }
+
+    object_arena(const object_arena&) = delete;
+    object_arena& operator=(const object_arena&) = delete;
+
+    ~object_arena()
+    {
+        reset();
+    }
+
+    template <typename T, typename... Ts>
+    auto make(Ts&&... xs)
+    {
+        // Every block starts at a `new[]`-aligned address.
+        static_assert(alignof(T) <= alignof(std::max_align_t), // .
+            "`T` is over-aligned for this arena.");
+
+        auto ptr(new(allocate(sizeof(T), alignof(T)))
+                T(std::forward<Ts>(xs)...));
+
+        // Resolved at compile-time: trivially destructible types don't cost
+        // anything at teardown.
+        if(!std::is_trivially_destructible<T>{})
+        {
+            // If registering the destructor fails, nobody would ever destroy
+            // the object: destroy it here. (Its storage is simply wasted until
+            // the next `reset()`.)
+            try
+            {
+                _destructors.push_back(destructor_entry{ptr, [](void* p)
+                    {
+                        static_cast<T*>(p)->~T();
+                    }});
+            }
+            catch(...)
+            {
+                ptr->~T();
+                throw;
+            }
+        }
+
+        return arena_ptr<T>{ptr, *this};
+    }
+
+    // Destroys all objects, in reverse construction order, and rewinds the
+    // arena. Blocks are kept for reuse.
+    void reset() noexcept
+    {
+        for(auto it(_destructors.rbegin()); it != _destructors.rend(); ++it)
+        {
+            it->_destroy(it->_ptr);
+        }
+
+        _destructors.clear();
+        _current = 0;
+        _used = 0;
+        ++_epoch;
+    }
+
+    auto epoch() const noexcept
+    {
+        return _epoch;
+    }
+
+    auto registered_destructors() const noexcept
+    {
+        return _destructors.size();
+    }
+};
+
+template <typename T>
+arena_ptr<T>::arena_ptr(T* ptr, const object_arena& a) noexcept : _ptr{ptr}
+{
+#ifndef NDEBUG
+    _arena = &a;
+    _epoch = a.epoch();
+#else
+    (void)a;
+#endif
+}
+
+template <typename T>
+void arena_ptr<T>::assert_alive() const noexcept
+{
+#ifndef NDEBUG
+    assert(_arena->epoch() == _epoch);
+#endif
+}
+
+// Example: the shape hierarchy, allocated in an arena.
+
+struct canvas
+{
+    double _ink{0};
+};
+
+struct shape
+{
+    virtual void draw(canvas& c) const = 0;
+
+protected:
+    // Shapes are never deleted through a `shape*`.
+    ~shape() = default;
+};
+
+struct rectangle final : shape
+{
+    float _w, _h;
+
+    rectangle(float w, float h) noexcept : _w{w}, _h{h}
+    {
+    }
+
+    void draw(canvas& c) const override
+    {
+        c._ink += _w * _h;
+    }
+};
+
+struct circle final : shape
+{
+    float _r;
+
+    circle(float r) noexcept : _r{r}
+    {
+    }
+
+    void draw(canvas& c) const override
+    {
+        c._ink += 3.14159f * _r * _r;
+    }
+};
+
+// Not trivially destructible, because of its `std::string` member.
+struct label final : shape
+{
+    std::string _text;
+
+    label(std::string text) : _text{std::move(text)}
+    {
+    }
+
+    void draw(canvas& c) const override
+    {
+        c._ink += _text.size();
+    }
+};
+
+static_assert(std::is_trivially_destructible<circle>{}, "");
+static_assert(std::is_trivially_destructible<rectangle>{}, "");
+static_assert(!std::is_trivially_destructible<label>{}, "");
+
+// The equivalent heap-allocated hierarchy, which we're replacing.
+
+namespace heap
+{
+    struct shape
+    {
+        virtual ~shape()
+        {
+        }
+
+        virtual void draw(canvas& c) const = 0;
+    };
+
+    struct rectangle final : shape
+    {
+        float _w, _h;
+
+        rectangle(float w, float h) noexcept : _w{w}, _h{h}
+        {
+        }
+
+        void draw(canvas& c) const override
+        {
+            c._ink += _w * _h;
+        }
+    };
+
+    struct circle final : shape
+    {
+        float _r;
+
+        circle(float r) noexcept : _r{r}
+        {
+        }
+
+        void draw(canvas& c) const override
+        {
+            c._ink += 3.14159f * _r * _r;
+        }
+    };
+
+    struct label final : shape
+    {
+        std::string _text;
+
+        label(std::string text) : _text{std::move(text)}
+        {
+        }
+
+        void draw(canvas& c) const override
+        {
+            c._ink += _text.size();
+        }
+    };
+}
+
+template <typename TF>
+auto time_ms(TF&& f)
+{
+    auto start(std::chrono::high_resolution_clock::now());
+    f();
+    auto end(std::chrono::high_resolution_clock::now());
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main()
+{
+    // Basic usage:
+    {
+        object_arena a;
+
+        arena_ptr<shape> s0(a.make<circle>(1.f));
+        arena_ptr<shape> s1(a.make<label>("hello"));
+        auto r(a.make<rectangle>(2.f, 3.f));
+
+        // Only `label` registered a destructor.
+        assert(a.registered_destructors() == 1);
+
+        // `to_base` and `to_derived` work as usual on arena objects.
+        assert(to_derived<circle>(s0.get())->_r == 1.f);
+        assert(to_derived<label>(s1.get())->_text == "hello");
+        assert(to_base<shape>(r.get()) != nullptr);
+
+        // Run-time assertion:
+        // to_derived<rectangle>(s0.get());
+
+        a.reset();
+        assert(a.registered_destructors() == 0);
+
+        // Run-time assertion (dangling handle):
+        // s0->draw(c);
+    }
+
+    // Does not compile, as intended (handles are unique):
+    /*
+        object_arena a;
+        auto c0(a.make<circle>(1.f));
+        auto c1(c0);
+    */
+
+    // Allocating, drawing and tearing down a million mixed shapes, for a few
+    // frames.
+    // (Compile with optimizations enabled to get meaningful numbers.)
+    {
+        constexpr std::size_t n{1000000};
+        constexpr int frames{5};
+
+        std::minstd_rand rng{1234};
+        std::vector<int> kinds(n);
+        for(auto& k : kinds) k = rng() % 3;
+
+        // Short enough to fit in the small string buffer, so that `label`
+        // doesn't allocate on its own.
+        const std::string text{"shape"};
+
+        double h_alloc{0}, h_teardown{0}, a_alloc{0}, a_teardown{0};
+        canvas hc, ac;
+
+        std::vector<std::unique_ptr<heap::shape>> ptrs;
+        ptrs.reserve(n);
+
+        object_arena a{1024 * 1024};
+        std::vector<arena_ptr<shape>> handles;
+        handles.reserve(n);
+
+        for(int f{0}; f < frames; ++f)
+        {
+            h_alloc += time_ms([&]
+                {
+                    for(auto k : kinds)
+                    {
+                        if(k == 0) ptrs.emplace_back(
+                            std::make_unique<heap::circle>(1.f));
+                        else if(k == 1) ptrs.emplace_back(
+                            std::make_unique<heap::rectangle>(1.f, 2.f));
+                        else ptrs.emplace_back(
+                            std::make_unique<heap::label>(text));
+                    }
+                });
+
+            for(const auto& p : ptrs) p->draw(hc);
+
+            h_teardown += time_ms([&]
+                {
+                    ptrs.clear();
+                });
+
+            a_alloc += time_ms([&]
+                {
+                    for(auto k : kinds)
+                    {
+                        if(k == 0) handles.emplace_back(
+                            a.make<circle>(1.f));
+                        else if(k == 1) handles.emplace_back(
+                            a.make<rectangle>(1.f, 2.f));
+                        else handles.emplace_back(a.make<label>(text));
+                    }
+                });
+
+            for(const auto& p : handles) p->draw(ac);
+
+            a_teardown += time_ms([&]
+                {
+                    handles.clear();
+                    a.reset();
+                });
+        }
+
+        assert(hc._ink == ac._ink);
+
+        std::cout << "make_unique: alloc " << h_alloc / frames
+                  << "ms, teardown " << h_teardown / frames << "ms\n"
+                  << "arena:       alloc " << a_alloc / frames
+                  << "ms, teardown " << a_teardown / frames << "ms\n";
+    }
+
+    return 0;
+}
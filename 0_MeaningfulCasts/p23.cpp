@@ -0,0 +1,681 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include "qualifier_utils.hpp"
+
+namespace impl
+{
+    template <typename TOut, typename T>
+    constexpr void assert_correct_polymorphic(T* ptr, std::true_type) noexcept
+    {
+        assert(dynamic_cast<TOut>(ptr) == ptr);
+        (void)ptr;
+    }
+
+    template <typename, typename T>
+    constexpr void assert_correct_polymorphic(T*, std::false_type) noexcept
+    {
+    }
+
+    // This overload will be called when `TDerived` uses kind tags, which also
+    // covers non-polymorphic hierarchies.
+    template <typename TDerived, typename T>
+    constexpr void assert_correct_kind(T* ptr, std::true_type) noexcept
+    {
+        assert(ptr->kind() >= TDerived::kind_first &&
+               ptr->kind() <= TDerived::kind_last);
+        (void)ptr;
+    }
+
+    template <typename, typename T>
+    constexpr void assert_correct_kind(T*, std::false_type) noexcept
+    {
+    }
+
+    template <typename...>
+    using void_t = void;
+
+    template <typename T, typename = void>
+    struct has_kind_range : std::false_type
+    {
+    };
+
+    template <typename T>
+    struct has_kind_range<T,
+        void_t<decltype(T::kind_first), decltype(T::kind_last)>>
+        : std::true_type
+    {
+    };
+
+    template <typename TDerived, typename TBase, typename TOut, typename T>
+    constexpr decltype(auto) hierarchy_cast(T* ptr) noexcept
+    {
+        static_assert(std::is_base_of<TBase, TDerived>{}, // .
+            "`TBase` is not a base class of `TDerived`.");
+
+        assert(ptr != nullptr);
+
+        assert_correct_polymorphic<TOut>(ptr, std::is_polymorphic<TBase>{});
+        assert_correct_kind<TDerived>(ptr, has_kind_range<TDerived>{});
+        return static_cast<TOut>(ptr);
+    }
+}
+
+template <typename TDerived, typename TBase>
+constexpr decltype(auto) to_derived(TBase* base) noexcept
+{
+    using result_type = copy_cv_qualifiers<TDerived, TBase>*;
+    return impl::hierarchy_cast<TDerived, TBase, result_type>(base);
+}
+
+// A common pattern when handling a hierarchy "from the outside" is a cascade
+// of downcast attempts:
+//
+//  if(auto c = dynamic_cast<circle*>(s)) { ... }
+//  else if(auto r = dynamic_cast<rectangle*>(s)) { ... }
+//  else if(auto t = dynamic_cast<triangle*>(s)) { ... }
+//
+// Every object pays for up to N `dynamic_cast`s, and failed ones are the most
+// expensive, as they have to walk the whole type graph.
+
+// If the set of types is closed and known at the call site, we can instead
+// compute the index of the object's dynamic type in the set once, and jump
+// straight to the matching handler through a table of function pointers. The
+// index is computed:
+//
+// * from the kind tag, if the hierarchy follows the kind-range protocol: a
+//   table mapping every kind to an index is built at compile-time;
+//
+// * otherwise, from the virtual table pointer: a small per-thread cache maps
+//   it to the index, and misses fall back to the cascade.
+
+// Handlers receive an already downcast reference, obtained with `to_derived`,
+// so debug builds still validate the index computation: with `dynamic_cast`
+// on polymorphic hierarchies, and against the kind range on kind-tagged ones.
+
+using kind_id = std::uint32_t;
+
+namespace impl
+{
+    template <bool... TBs>
+    using all_true = std::is_same<std::integer_sequence<bool, true, TBs...>,
+        std::integer_sequence<bool, TBs..., true>>;
+
+    template <typename TF, typename TArg, typename = void>
+    struct is_callable_with : std::false_type
+    {
+    };
+
+    template <typename TF, typename TArg>
+    struct is_callable_with<TF, TArg,
+        void_t<decltype(std::declval<TF&>()(std::declval<TArg>()))>>
+        : std::true_type
+    {
+    };
+
+    template <typename TF, typename... TFs>
+    struct overload_set : TF, overload_set<TFs...>
+    {
+        using TF::operator();
+        using overload_set<TFs...>::operator();
+
+        overload_set(TF f, TFs... fs)
+            : TF(std::move(f)), overload_set<TFs...>(std::move(fs)...)
+        {
+        }
+    };
+
+    template <typename TF>
+    struct overload_set<TF> : TF
+    {
+        using TF::operator();
+
+        overload_set(TF f) : TF(std::move(f))
+        {
+        }
+    };
+
+    template <typename... TFs>
+    auto make_overload_set(TFs... fs)
+    {
+        return overload_set<TFs...>(std::move(fs)...);
+    }
+
+    template <typename T>
+    auto vptr_of(T* ptr) noexcept
+    {
+        // Not portable C++, but every mainstream ABI stores the virtual table
+        // pointer at offset zero of every polymorphic subobject.
+        const void* result;
+        std::memcpy(&result, ptr, sizeof(result));
+        return result;
+    }
+
+    // Index of the first type in `Ts...` that `ptr` points to, or
+    // `sizeof...(Ts)`. This is the cascade.
+    template <typename... Ts, typename TBase>
+    auto index_by_dynamic_cast(TBase* ptr) noexcept
+    {
+        std::size_t result{0};
+        bool found{false};
+
+        using expander = int[];
+        (void)expander{(
+            found = found ||
+                    dynamic_cast<copy_cv_qualifiers<Ts, TBase>*>(ptr) ||
+                    (++result, false),
+            0)...};
+
+        return result;
+    }
+
+    // Maps every kind in `TBase`'s range to the index of the first type in
+    // `Ts...` whose range contains it.
+    template <typename TBase, typename... Ts>
+    struct kind_index_table
+    {
+        static constexpr std::size_t size{
+            TBase::kind_last - TBase::kind_first + 1};
+
+        std::uint8_t _data[size];
+
+        constexpr kind_index_table() : _data{}
+        {
+            constexpr kind_id firsts[]{Ts::kind_first...};
+            constexpr kind_id lasts[]{Ts::kind_last...};
+
+            for(auto& x : _data) x = sizeof...(Ts);
+
+            // Backwards, so that earlier types win.
+            for(auto i(sizeof...(Ts)); i-- > 0;)
+            {
+                for(auto k(firsts[i]); k <= lasts[i]; ++k)
+                {
+                    _data[k - TBase::kind_first] = i;
+                }
+            }
+        }
+    };
+
+    // This overload will be called when the hierarchy uses kind tags.
+    template <typename... Ts, typename TBase>
+    auto type_index(TBase* ptr, std::true_type) noexcept
+    {
+        static constexpr kind_index_table<std::remove_cv_t<TBase>, Ts...>
+            table{};
+
+        const auto k(ptr->kind());
+        assert(k >= TBase::kind_first && k <= TBase::kind_last);
+
+        return std::size_t{table._data[k - TBase::kind_first]};
+    }
+
+    // This overload will be called otherwise.
+    template <typename... Ts, typename TBase>
+    auto type_index(TBase* ptr, std::false_type) noexcept
+    {
+        static_assert(std::is_polymorphic<TBase>{}, // .
+            "`TBase` must be polymorphic, or use kind tags.");
+
+        struct entry
+        {
+            const void* _vptr{nullptr};
+            std::size_t _index{0};
+        };
+
+        // One cache per set of types, and per thread.
+        constexpr std::size_t size_bits{4};
+        thread_local entry entries[std::size_t{1} << size_bits];
+
+        const auto vptr(vptr_of(ptr));
+        auto bits(static_cast<std::uint64_t>(
+            reinterpret_cast<std::uintptr_t>(vptr)));
+
+        auto& e(entries[(bits * 0x9E3779B97F4A7C15ull) >> (64 - size_bits)]);
+        if(e._vptr != vptr)
+        {
+            e._vptr = vptr;
+            e._index = index_by_dynamic_cast<Ts...>(ptr);
+        }
+
+        return e._index;
+    }
+
+    [[noreturn]] inline void unhandled_type() noexcept
+    {
+        std::cerr << "type_switch: unhandled dynamic type\n";
+        std::abort();
+    }
+
+    // A default handler is a non-generic handler callable with `TBase&`.
+    // Generic handlers (such as `[](const auto&)`) are never used as a
+    // default, so that they can't silently swallow unlisted types.
+    template <typename TF, typename = void>
+    struct has_plain_call_operator : std::false_type
+    {
+    };
+
+    template <typename TF>
+    struct has_plain_call_operator<TF, void_t<decltype(&TF::operator())>>
+        : std::true_type
+    {
+    };
+
+    template <typename TF, typename TBase,
+        bool = has_plain_call_operator<TF>{}>
+    struct is_default_handler : is_callable_with<TF, TBase&>
+    {
+    };
+
+    template <typename TF, typename TBase>
+    struct is_default_handler<TF, TBase, false> : std::false_type
+    {
+    };
+
+    // First default handler in `TFs...`, or `void`.
+    template <typename TBase, typename... TFs>
+    struct find_default_handler
+    {
+        using type = void;
+    };
+
+    template <typename TBase, typename TF, typename... TFs>
+    struct find_default_handler<TBase, TF, TFs...>
+        : std::conditional_t<is_default_handler<TF, TBase>{},
+              std::common_type<TF>, find_default_handler<TBase, TFs...>>
+    {
+    };
+
+    // This overload will be called when there is a default handler.
+    template <typename TR, typename TDefault, typename TBase, typename TF>
+    auto call_default(TBase* ptr, TF& f)
+        -> std::enable_if_t<!std::is_void<TDefault>{}, TR>
+    {
+        // Calling the handler directly, instead of through the overload set,
+        // guarantees that it is the one receiving `TBase&`.
+        return static_cast<TDefault&>(f)(*ptr);
+    }
+
+    // This overload will be called otherwise.
+    template <typename TR, typename TDefault, typename TBase, typename TF>
+    auto call_default(TBase*, TF&)
+        -> std::enable_if_t<std::is_void<TDefault>{}, TR>
+    {
+        unhandled_type();
+    }
+}
+
+// Calls the handler overload matching the dynamic type of `*base`. If no type
+// in `Ts...` matches, the default handler (a non-generic handler taking
+// `TBase&`) is called if there is one, and the program is aborted otherwise.
+template <typename... Ts, typename TBase, typename... TFs>
+decltype(auto) type_switch(TBase* base, TFs... handlers)
+{
+    static_assert(sizeof...(Ts) > 0 && sizeof...(Ts) < 255, "");
+
+    static_assert(impl::all_true<std::is_base_of<TBase, Ts>{}...>{}, // .
+        "Every type in `Ts...` must derive from `TBase`.");
+
+    static_assert(std::is_polymorphic<TBase>{} ||
+                      impl::has_kind_range<TBase>{},
+        "`TBase` must be polymorphic, or use kind tags.");
+
+    assert(base != nullptr);
+
+    auto f(impl::make_overload_set(std::move(handlers)...));
+    using f_type = decltype(f);
+
+    using result_type = std::common_type_t<decltype(std::declval<f_type&>()(
+        std::declval<copy_cv_qualifiers<Ts, TBase>&>()))...>;
+
+    using default_type =
+        typename impl::find_default_handler<TBase, TFs...>::type;
+
+    using thunk = result_type (*)(TBase*, f_type&);
+
+    static constexpr thunk table[]{
+        [](TBase* ptr, f_type& fn) -> result_type
+        {
+            return fn(*to_derived<Ts>(ptr));
+        }...,
+        [](TBase* ptr, f_type& fn) -> result_type
+        {
+            return impl::call_default<result_type, default_type>(ptr, fn);
+        }};
+
+    const auto i(impl::type_index<Ts...>(base, impl::has_kind_range<TBase>{}));
+    return table[i](base, f);
+}
+
+// Example: the shape hierarchy, with and without kind tags.
+
+struct shape
+{
+    virtual ~shape()
+    {
+    }
+};
+
+struct circle final : shape
+{
+    float _r{1.f};
+};
+
+struct rectangle final : shape
+{
+    float _w{2.f}, _h{3.f};
+};
+
+struct triangle final : shape
+{
+};
+
+//  tagged_shape       [0, 3]
+//  |- tagged_circle   [1, 1]
+//  `- tagged_polygon  [2, 3]
+//     `- tagged_square [3, 3]
+
+struct tagged_shape
+{
+    static constexpr kind_id kind_first{0};
+    static constexpr kind_id kind_last{3};
+
+    const kind_id _kind;
+
+    tagged_shape(kind_id k) noexcept : _kind{k}
+    {
+    }
+
+    auto kind() const noexcept
+    {
+        return _kind;
+    }
+};
+
+struct tagged_circle : tagged_shape
+{
+    static constexpr kind_id kind_first{1};
+    static constexpr kind_id kind_last{1};
+
+    tagged_circle() noexcept : tagged_shape{kind_first}
+    {
+    }
+};
+
+struct tagged_polygon : tagged_shape
+{
+    static constexpr kind_id kind_first{2};
+    static constexpr kind_id kind_last{3};
+
+    tagged_polygon(kind_id k = kind_first) noexcept : tagged_shape{k}
+    {
+    }
+};
+
+struct tagged_square : tagged_polygon
+{
+    static constexpr kind_id kind_first{3};
+    static constexpr kind_id kind_last{3};
+
+    tagged_square() noexcept : tagged_polygon{kind_first}
+    {
+    }
+};
+
+// For benchmarking, let's generate two hierarchies of `width` siblings, with
+// and without kind tags.
+
+constexpr int width{8};
+
+struct kind_root
+{
+    static constexpr kind_id kind_first{0};
+    static constexpr kind_id kind_last{width};
+
+    const kind_id _kind;
+
+    kind_root(kind_id k) noexcept : _kind{k}
+    {
+    }
+
+    virtual ~kind_root()
+    {
+    }
+
+    auto kind() const noexcept
+    {
+        return _kind;
+    }
+};
+
+template <int TI>
+struct kind_leaf final : kind_root
+{
+    static constexpr kind_id kind_first{TI + 1};
+    static constexpr kind_id kind_last{TI + 1};
+
+    kind_leaf() noexcept : kind_root{kind_first}
+    {
+    }
+
+    int value() const noexcept
+    {
+        return TI;
+    }
+};
+
+struct plain_root
+{
+    virtual ~plain_root()
+    {
+    }
+};
+
+template <int TI>
+struct plain_leaf final : plain_root
+{
+    int value() const noexcept
+    {
+        return TI;
+    }
+};
+
+// The cascade, written out for any number of types.
+template <typename TBase, typename TF>
+int cascade(TBase*, TF&)
+{
+    return 0;
+}
+
+template <typename T, typename... Ts, typename TBase, typename TF>
+int cascade(TBase* base, TF& f)
+{
+    if(auto p = dynamic_cast<T*>(base)) return f(*p);
+    return cascade<Ts...>(base, f);
+}
+
+template <template <int> class TLeaf, typename TBase, int... TIs>
+auto make_objects(std::size_t n, std::integer_sequence<int, TIs...>)
+{
+    using factory = std::unique_ptr<TBase> (*)();
+    constexpr factory factories[]{[]() -> std::unique_ptr<TBase>
+        {
+            return std::make_unique<TLeaf<TIs>>();
+        }...};
+
+    std::minstd_rand rng{1234};
+    std::vector<std::unique_ptr<TBase>> result;
+    for(std::size_t i{0}; i < n; ++i)
+    {
+        result.emplace_back(factories[rng() % sizeof...(TIs)]());
+    }
+
+    return result;
+}
+
+template <template <int> class TLeaf, typename TBase, int... TIs>
+auto sum_with_type_switch(const std::vector<std::unique_ptr<TBase>>& objects,
+    std::integer_sequence<int, TIs...>)
+{
+    std::int64_t result{0};
+    for(const auto& p : objects)
+    {
+        result += type_switch<TLeaf<TIs>...>(p.get(),
+            [](const auto& x)
+            {
+                return x.value();
+            });
+    }
+
+    return result;
+}
+
+template <template <int> class TLeaf, typename TBase, int... TIs>
+auto sum_with_cascade(const std::vector<std::unique_ptr<TBase>>& objects,
+    std::integer_sequence<int, TIs...>)
+{
+    auto f([](const auto& x)
+        {
+            return x.value();
+        });
+
+    std::int64_t result{0};
+    for(const auto& p : objects) result += cascade<TLeaf<TIs>...>(p.get(), f);
+
+    return result;
+}
+
+template <typename TF>
+auto time_ms(TF&& f)
+{
+    auto start(std::chrono::high_resolution_clock::now());
+    f();
+    auto end(std::chrono::high_resolution_clock::now());
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main()
+{
+    // Basic usage (virtual table pointer):
+    {
+        rectangle r;
+        shape* s{&r};
+
+        auto area(type_switch<circle, rectangle>(s,
+            [](circle& c)
+            {
+                return 3.14159f * c._r * c._r;
+            },
+            [](rectangle& x)
+            {
+                return x._w * x._h;
+            }));
+
+        assert(area == 6.f);
+        (void)area;
+
+        // Unlisted types go to the non-generic `shape&` handler, if any.
+        triangle t;
+        s = &t;
+
+        auto name(type_switch<circle, rectangle>(s,
+            [](const auto&)
+            {
+                return "known";
+            },
+            [](shape&)
+            {
+                return "unknown";
+            }));
+
+        assert(std::string{name} == "unknown");
+        (void)name;
+
+        // Aborts at run-time (no handler for `triangle`, as generic handlers
+        // are never used as a default):
+        /*
+            type_switch<circle, rectangle>(s, [](const auto&) { });
+        */
+    }
+
+    // Basic usage (kind tags, with a non-leaf type):
+    {
+        tagged_square sq;
+        tagged_shape* s{&sq};
+
+        auto name(type_switch<tagged_circle, tagged_polygon>(s,
+            [](tagged_circle&)
+            {
+                return "circle";
+            },
+            [](tagged_polygon&)
+            {
+                return "polygon";
+            }));
+
+        assert(std::string{name} == "polygon");
+        (void)name;
+    }
+
+    // Does not compile, as intended (missing handler for `rectangle`):
+    /*
+        shape* s{nullptr};
+        type_switch<circle, rectangle>(s, [](circle&) { });
+    */
+
+    // Dispatching over 10M objects of `width` types.
+    // (Compile with optimizations enabled to get meaningful numbers.)
+    {
+        constexpr std::size_t n{10000000};
+        constexpr auto is(std::make_integer_sequence<int, width>{});
+
+        auto plain(make_objects<plain_leaf, plain_root>(n, is));
+        auto kinds(make_objects<kind_leaf, kind_root>(n, is));
+
+        std::int64_t s0{0}, s1{0}, s2{0}, s3{0};
+
+        auto cascade_ms(time_ms([&]
+            {
+                s0 = sum_with_cascade<plain_leaf>(plain, is);
+            }));
+
+        auto vptr_ms(time_ms([&]
+            {
+                s1 = sum_with_type_switch<plain_leaf>(plain, is);
+            }));
+
+        auto kind_cascade_ms(time_ms([&]
+            {
+                s2 = sum_with_cascade<kind_leaf>(kinds, is);
+            }));
+
+        auto kind_ms(time_ms([&]
+            {
+                s3 = sum_with_type_switch<kind_leaf>(kinds, is);
+            }));
+
+        assert(s0 == s1 && s2 == s3);
+
+        std::cout << "dynamic_cast cascade:    " << cascade_ms << "ms\n"
+                  << "type_switch, vptr cache: " << vptr_ms << "ms\n"
+                  << "dynamic_cast cascade:    " << kind_cascade_ms
+                  << "ms (kind-tagged hierarchy)\n"
+                  << "type_switch, kind table: " << kind_ms << "ms\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,510 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "qualifier_utils.hpp"
+
+// Compile with `-DHIERARCHY_CAST_PROFILING` to enable the cast profiler.
+#ifdef HIERARCHY_CAST_PROFILING
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <typeinfo>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+#endif
+
+// The checks performed by `hierarchy_cast` are not free: polymorphic downcasts
+// are validated with `dynamic_cast`. Before moving some of them to cheaper
+// strategies (`final` classes, kind tags, caches), we need to know which ones
+// are actually hot.
+
+// The profiling mode records, for every (source type, target type, call site)
+// triple:
+//
+// * the number of casts;
+//
+// * the cost of the check in cycles (read with `rdtsc`), measured on one cast
+//   out of `sample_period`, to keep the overhead low.
+//
+// Counters live in per-thread tables, so that the hot path doesn't need any
+// synchronization. Tables register themselves in a global registry, which the
+// report API walks. Call sites are identified by a tag type, as in
+// `cached_dynamic_cast`.
+
+// When `HIERARCHY_CAST_PROFILING` is not defined, none of the profiling code
+// is compiled, and the casts are exactly the usual ones. When it is, the
+// checks are always performed, even with `NDEBUG` defined: otherwise the
+// profiler would time empty code. A failed check aborts the program.
+
+// Only the first `max_cast_sites - 1` sites get their own counters: any
+// further site is aggregated into a final "(other)" record.
+
+namespace impl
+{
+#ifdef HIERARCHY_CAST_PROFILING
+    constexpr std::uint64_t sample_period{64};
+    constexpr std::size_t max_cast_sites{256};
+    constexpr std::size_t overflow_cast_site{max_cast_sites - 1};
+
+#if defined(__x86_64__) || defined(__i386__)
+    inline std::uint64_t read_cycles() noexcept
+    {
+        // Not serializing, but precise enough to compare checks with each
+        // other.
+        return __rdtsc();
+    }
+#else
+    inline std::uint64_t read_cycles() noexcept
+    {
+        // Fallback: nanoseconds instead of cycles.
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+#endif
+
+    inline std::string type_name(const std::type_info& ti)
+    {
+#if defined(__GNUG__)
+        int status;
+        std::unique_ptr<char, void (*)(void*)> demangled{
+            abi::__cxa_demangle(ti.name(), nullptr, nullptr, &status),
+            std::free};
+
+        if(status == 0) return demangled.get();
+#endif
+
+        return ti.name();
+    }
+
+    // Only written by the owning thread, but read by `cast_profile_report`
+    // from any thread: relaxed atomics avoid data races without adding any
+    // locked instructions.
+    struct cast_site_counters
+    {
+        std::atomic<std::uint64_t> _calls{0};
+        std::atomic<std::uint64_t> _sampled{0};
+        std::atomic<std::uint64_t> _sampled_cycles{0};
+
+        static void bump(std::atomic<std::uint64_t>& x, std::uint64_t n)
+        {
+            x.store(x.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+        }
+    };
+
+    struct cast_site_totals
+    {
+        std::uint64_t _calls{0};
+        std::uint64_t _sampled{0};
+        std::uint64_t _sampled_cycles{0};
+
+        void add(const cast_site_counters& c) noexcept
+        {
+            _calls += c._calls.load(std::memory_order_relaxed);
+            _sampled += c._sampled.load(std::memory_order_relaxed);
+            _sampled_cycles +=
+                c._sampled_cycles.load(std::memory_order_relaxed);
+        }
+    };
+
+    struct cast_site_info
+    {
+        std::string _from;
+        std::string _to;
+        std::string _call_site;
+    };
+
+    class cast_thread_table;
+
+    class cast_profile_registry
+    {
+        friend class cast_thread_table;
+
+    private:
+        std::mutex _mutex;
+        std::vector<cast_site_info> _sites;
+        std::vector<cast_thread_table*> _threads;
+
+        // Counters of threads that already exited.
+        cast_site_totals _retired[max_cast_sites];
+
+    public:
+        auto register_site(const std::type_info& from,
+            const std::type_info& to, const std::type_info& call_site)
+        {
+            std::lock_guard<std::mutex> l{_mutex};
+
+            // Never write past the counter tables, even with `NDEBUG`.
+            if(_sites.size() >= overflow_cast_site)
+            {
+                if(_sites.size() == overflow_cast_site)
+                {
+                    _sites.push_back(
+                        cast_site_info{"(other)", "(other)", "(other)"});
+                }
+
+                return overflow_cast_site;
+            }
+
+            const bool any_site{call_site == typeid(void)};
+            _sites.push_back(cast_site_info{type_name(from), type_name(to),
+                any_site ? "(any)" : type_name(call_site)});
+
+            return _sites.size() - 1;
+        }
+
+        template <typename TF>
+        void for_each_site(TF&& f);
+    };
+
+    inline auto& get_cast_profile_registry()
+    {
+        static cast_profile_registry r;
+        return r;
+    }
+
+    class cast_thread_table
+    {
+    private:
+        cast_site_counters _counters[max_cast_sites];
+
+    public:
+        cast_thread_table()
+        {
+            auto& r(get_cast_profile_registry());
+            std::lock_guard<std::mutex> l{r._mutex};
+            r._threads.push_back(this);
+        }
+
+        ~cast_thread_table()
+        {
+            auto& r(get_cast_profile_registry());
+            std::lock_guard<std::mutex> l{r._mutex};
+
+            for(std::size_t i{0}; i < r._sites.size(); ++i)
+            {
+                r._retired[i].add(_counters[i]);
+            }
+
+            r._threads.erase(
+                std::find(r._threads.begin(), r._threads.end(), this));
+        }
+
+        auto& operator[](std::size_t id) noexcept
+        {
+            return _counters[id];
+        }
+    };
+
+    template <typename TF>
+    void cast_profile_registry::for_each_site(TF&& f)
+    {
+        std::lock_guard<std::mutex> l{_mutex};
+
+        for(std::size_t i{0}; i < _sites.size(); ++i)
+        {
+            auto totals(_retired[i]);
+            for(auto t : _threads) totals.add((*t)[i]);
+
+            f(_sites[i], totals);
+        }
+    }
+
+    inline auto& get_cast_thread_table()
+    {
+        thread_local cast_thread_table t;
+        return t;
+    }
+
+    template <typename TFrom, typename TTo, typename TCallSite>
+    auto cast_site_id()
+    {
+        static const auto id(get_cast_profile_registry().register_site(
+            typeid(TFrom), typeid(TTo), typeid(TCallSite)));
+
+        return id;
+    }
+
+    [[noreturn]] inline void failed_cast_check() noexcept
+    {
+        std::cerr << "hierarchy_cast: invalid downcast\n";
+        std::abort();
+    }
+
+    // `check` returns whether the cast is valid.
+    template <typename TFrom, typename TTo, typename TCallSite, typename TF>
+    void profile_cast_check(TF&& check)
+    {
+        auto& c(get_cast_thread_table()[cast_site_id<TFrom, TTo, TCallSite>()]);
+
+        const auto calls(c._calls.load(std::memory_order_relaxed));
+        c._calls.store(calls + 1, std::memory_order_relaxed);
+
+        if(calls % sample_period != 0)
+        {
+            if(!check()) failed_cast_check();
+            return;
+        }
+
+        const auto start(read_cycles());
+        const bool valid{check()};
+        const auto end(read_cycles());
+
+        if(!valid) failed_cast_check();
+
+        cast_site_counters::bump(c._sampled, 1);
+        cast_site_counters::bump(c._sampled_cycles, end - start);
+    }
+#endif
+
+    template <typename TOut, typename T>
+    constexpr void assert_correct_polymorphic(T* ptr, std::true_type) noexcept
+    {
+        assert(dynamic_cast<TOut>(ptr) == ptr);
+        (void)ptr;
+    }
+
+    template <typename, typename T>
+    constexpr void assert_correct_polymorphic(T*, std::false_type) noexcept
+    {
+    }
+
+#ifdef HIERARCHY_CAST_PROFILING
+    // Same checks as above, independent of `assert`.
+    template <typename TOut, typename T>
+    bool is_correct_polymorphic(T* ptr, std::true_type) noexcept
+    {
+        return dynamic_cast<TOut>(ptr) == ptr;
+    }
+
+    template <typename, typename T>
+    constexpr bool is_correct_polymorphic(T*, std::false_type) noexcept
+    {
+        return true;
+    }
+#endif
+
+    template <typename TDerived, typename TBase, typename TOut,
+        typename TCallSite, typename T>
+    constexpr decltype(auto) hierarchy_cast(T* ptr) noexcept
+    {
+        static_assert(std::is_base_of<TBase, TDerived>{}, // .
+            "`TBase` is not a base class of `TDerived`.");
+
+        // Sanity check.
+        assert(ptr != nullptr);
+
+#ifdef HIERARCHY_CAST_PROFILING
+        profile_cast_check<std::remove_cv_t<T>,
+            std::remove_cv_t<std::remove_pointer_t<TOut>>, TCallSite>([&]
+            {
+                return is_correct_polymorphic<TOut>(
+                    ptr, std::is_polymorphic<TBase>{});
+            });
+#else
+        assert_correct_polymorphic<TOut>(ptr, std::is_polymorphic<TBase>{});
+#endif
+
+        return static_cast<TOut>(ptr);
+    }
+}
+
+// Pass a unique `TCallSite` type to profile a call site separately: by
+// default, all the casts between the same pair of types are grouped together.
+
+template <typename TDerived, typename TCallSite = void, typename TBase>
+constexpr decltype(auto) to_derived(TBase* base) noexcept
+{
+    using result_type = copy_cv_qualifiers<TDerived, TBase>*;
+    return impl::hierarchy_cast<TDerived, TBase, result_type, TCallSite>(base);
+}
+
+template <typename TBase, typename TCallSite = void, typename TDerived>
+constexpr decltype(auto) to_base(TDerived* derived) noexcept
+{
+    using result_type = copy_cv_qualifiers<TBase, TDerived>*;
+    return impl::hierarchy_cast<TDerived, TBase, result_type, TCallSite>(
+        derived);
+}
+
+#ifdef HIERARCHY_CAST_PROFILING
+struct cast_profile_record
+{
+    std::string _from;
+    std::string _to;
+    std::string _call_site;
+    std::uint64_t _calls;
+    std::uint64_t _sampled;
+    std::uint64_t _sampled_cycles;
+
+    auto average_cycles() const noexcept
+    {
+        return _sampled == 0 ? 0.0 : double(_sampled_cycles) / _sampled;
+    }
+
+    // Extrapolated from the samples.
+    auto estimated_cycles() const noexcept
+    {
+        return average_cycles() * _calls;
+    }
+};
+
+// Returns the records of all threads, including the ones that already exited,
+// sorted by decreasing estimated cost.
+inline auto cast_profile_report()
+{
+    std::vector<cast_profile_record> result;
+
+    impl::get_cast_profile_registry().for_each_site(
+        [&](const auto& info, const auto& totals)
+        {
+            result.push_back(cast_profile_record{info._from, info._to,
+                info._call_site, totals._calls, totals._sampled,
+                totals._sampled_cycles});
+        });
+
+    std::sort(result.begin(), result.end(), [](const auto& a, const auto& b)
+        {
+            return a.estimated_cycles() > b.estimated_cycles();
+        });
+
+    return result;
+}
+
+inline void print_cast_profile_report(std::ostream& os)
+{
+    for(const auto& r : cast_profile_report())
+    {
+        os << r._from << " -> " << r._to << " [" << r._call_site
+           << "]: " << r._calls << " casts, ~" << r.average_cycles()
+           << " cycles/check, ~" << r.estimated_cycles() << " cycles total\n";
+    }
+}
+#endif
+
+// Example: the shape hierarchy.
+
+struct shape
+{
+    virtual ~shape()
+    {
+    }
+
+    virtual int sides() const noexcept = 0;
+};
+
+struct polygon : shape
+{
+};
+
+struct rectangle : polygon
+{
+    int sides() const noexcept override
+    {
+        return 4;
+    }
+};
+
+struct circle final : shape
+{
+    int sides() const noexcept override
+    {
+        return 0;
+    }
+};
+
+struct hot_call_site
+{
+};
+
+struct cold_call_site
+{
+};
+
+template <typename TF>
+auto time_ms(TF&& f)
+{
+    auto start(std::chrono::high_resolution_clock::now());
+    f();
+    auto end(std::chrono::high_resolution_clock::now());
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main()
+{
+#ifdef HIERARCHY_CAST_PROFILING
+    std::cout << "cast profiling enabled\n";
+#endif
+
+    // Casting from several threads and call sites.
+    // (Build with and without `-DHIERARCHY_CAST_PROFILING`, and with
+    // optimizations enabled, to measure the profiler's overhead.)
+    {
+        auto r(std::make_unique<rectangle>());
+        auto c(std::make_unique<circle>());
+
+        auto work([&]
+            {
+                int sides{0};
+
+                for(int i{0}; i < 1000000; ++i)
+                {
+                    shape* s{r.get()};
+                    sides += to_derived<rectangle, hot_call_site>(s)->sides();
+                    sides += to_derived<polygon, hot_call_site>(s)->sides();
+
+                    if(i % 100 == 0)
+                    {
+                        shape* s2{c.get()};
+                        auto c2(to_derived<circle, cold_call_site>(s2));
+                        sides += c2->sides();
+                        sides += to_base<shape>(r.get())->sides();
+                    }
+                }
+
+                return sides;
+            });
+
+        auto ms(time_ms([&]
+            {
+                std::vector<std::thread> threads;
+                for(int t{0}; t < 4; ++t) threads.emplace_back(work);
+                for(auto& t : threads) t.join();
+            }));
+
+        std::cout << "4 threads: " << ms << "ms\n";
+    }
+
+#ifdef HIERARCHY_CAST_PROFILING
+    // The threads have exited, but their counters were retired into the
+    // registry.
+    {
+        auto report(cast_profile_report());
+        assert(report.size() == 4);
+        assert(report[0]._calls == 4 * 1000000);
+
+        print_cast_profile_report(std::cout);
+    }
+#endif
+
+    return 0;
+}
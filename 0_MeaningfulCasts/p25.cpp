@@ -0,0 +1,352 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "qualifier_utils.hpp"
+
+namespace impl
+{
+    template <typename TOut, typename T>
+    constexpr void assert_correct_polymorphic(T* ptr, std::true_type) noexcept
+    {
+        assert(dynamic_cast<TOut>(ptr) == ptr);
+        (void)ptr;
+    }
+
+    template <typename, typename T>
+    constexpr void assert_correct_polymorphic(T*, std::false_type) noexcept
+    {
+    }
+
+    template <typename TDerived, typename TBase, typename TOut, typename T>
+    constexpr decltype(auto) hierarchy_cast(T* ptr) noexcept
+    {
+        static_assert(std::is_base_of<TBase, TDerived>{}, // .
+            "`TBase` is not a base class of `TDerived`.");
+
+        assert(ptr != nullptr);
+
+        assert_correct_polymorphic<TOut>(ptr, std::is_polymorphic<TBase>{});
+        return static_cast<TOut>(ptr);
+    }
+}
+
+template <typename TDerived, typename TBase>
+constexpr decltype(auto) to_derived(TBase* base) noexcept
+{
+    using result_type = copy_cv_qualifiers<TDerived, TBase>*;
+    return impl::hierarchy_cast<TDerived, TBase, result_type>(base);
+}
+
+template <typename TBase, typename TDerived>
+constexpr decltype(auto) to_base(TDerived* derived) noexcept
+{
+    using result_type = copy_cv_qualifiers<TBase, TDerived>*;
+    return impl::hierarchy_cast<TDerived, TBase, result_type>(derived);
+}
+
+// With smart pointers, the usual tools are `std::static_pointer_cast` and
+// `std::dynamic_pointer_cast`. They take the source pointer by `const&`, so
+// casting a `std::shared_ptr` always creates a new owner: one atomic increment
+// now, and one atomic decrement when the source (or the result) dies. Even a
+// temporary cast, used only to call a member function, pays for both, and
+// all threads sharing the object fight over the same cache line.
+
+// We can overload `to_derived` and `to_base` on smart pointers, and use the
+// value category of the argument to pick the right semantics:
+//
+// * rvalues transfer ownership to the result, without touching the reference
+//   count;
+//
+// * lvalues are "borrowed": the result is a raw pointer, valid as long as the
+//   source smart pointer is, which is all that temporary uses need.
+//
+// Either way, validation goes through `hierarchy_cast`, on the raw pointer.
+
+namespace impl
+{
+    // `std::default_delete<TBase>` cannot be converted to
+    // `std::default_delete<TDerived>`, so we rebind it. Other deleters are
+    // moved into the result, and must accept the result's pointer type.
+    template <typename TDeleter, typename T>
+    struct rebind_deleter_helper
+    {
+        using type = TDeleter;
+
+        static auto convert(TDeleter& d) noexcept
+        {
+            return std::move(d);
+        }
+    };
+
+    template <typename TFrom, typename T>
+    struct rebind_deleter_helper<std::default_delete<TFrom>, T>
+    {
+        using type = std::default_delete<T>;
+
+        static_assert(!std::is_base_of<T, TFrom>{} ||
+                          std::is_same<std::remove_cv_t<T>, TFrom>{} ||
+                          std::has_virtual_destructor<T>{},
+            "Deleting through `T*` requires a virtual destructor.");
+
+        static auto convert(std::default_delete<TFrom>&) noexcept
+        {
+            return type{};
+        }
+    };
+
+    template <typename TResult, typename TSource, typename TDeleter>
+    auto transfer_unique(std::unique_ptr<TSource, TDeleter>& p, TResult* raw)
+    {
+        using helper = rebind_deleter_helper<TDeleter, TResult>;
+
+        std::unique_ptr<TResult, typename helper::type> result{
+            raw, helper::convert(p.get_deleter())};
+
+        p.release();
+        return result;
+    }
+
+    template <typename TResult, typename TSource>
+    auto transfer_shared(std::shared_ptr<TSource>& p, TResult* raw)
+    {
+#if __cplusplus > 201703L
+        // C++20's aliasing constructor takes the source by rvalue reference,
+        // stealing its ownership.
+        return std::shared_ptr<TResult>(std::move(p), raw);
+#else
+        // Before C++20, the aliasing constructor always copies: we can't
+        // avoid a reference count increment and decrement here.
+        std::shared_ptr<TResult> result(p, raw);
+        p.reset();
+        return result;
+#endif
+    }
+}
+
+// Ownership-transferring overloads.
+
+template <typename TDerived, typename TBase, typename TDeleter>
+auto to_derived(std::unique_ptr<TBase, TDeleter>&& base) noexcept
+{
+    return impl::transfer_unique(base, to_derived<TDerived>(base.get()));
+}
+
+template <typename TBase, typename TDerived, typename TDeleter>
+auto to_base(std::unique_ptr<TDerived, TDeleter>&& derived) noexcept
+{
+    return impl::transfer_unique(derived, to_base<TBase>(derived.get()));
+}
+
+template <typename TDerived, typename TBase>
+auto to_derived(std::shared_ptr<TBase>&& base) noexcept
+{
+    return impl::transfer_shared(base, to_derived<TDerived>(base.get()));
+}
+
+template <typename TBase, typename TDerived>
+auto to_base(std::shared_ptr<TDerived>&& derived) noexcept
+{
+    using result_type = copy_cv_qualifiers<TBase, TDerived>;
+
+    // Upcasts can use the converting move constructor in every standard.
+    to_base<TBase>(derived.get());
+    return std::shared_ptr<result_type>(std::move(derived));
+}
+
+// Borrowing overloads.
+
+template <typename TDerived, typename TBase, typename TDeleter>
+auto to_derived(const std::unique_ptr<TBase, TDeleter>& base) noexcept
+{
+    return to_derived<TDerived>(base.get());
+}
+
+template <typename TBase, typename TDerived, typename TDeleter>
+auto to_base(const std::unique_ptr<TDerived, TDeleter>& derived) noexcept
+{
+    return to_base<TBase>(derived.get());
+}
+
+template <typename TDerived, typename TBase>
+auto to_derived(const std::shared_ptr<TBase>& base) noexcept
+{
+    return to_derived<TDerived>(base.get());
+}
+
+template <typename TBase, typename TDerived>
+auto to_base(const std::shared_ptr<TDerived>& derived) noexcept
+{
+    return to_base<TBase>(derived.get());
+}
+
+// Const rvalues would otherwise bind to the borrowing overloads, returning a
+// raw pointer to an object owned by a temporary.
+
+template <typename TDerived, typename TBase, typename TDeleter>
+void to_derived(const std::unique_ptr<TBase, TDeleter>&&) = delete;
+
+template <typename TBase, typename TDerived, typename TDeleter>
+void to_base(const std::unique_ptr<TDerived, TDeleter>&&) = delete;
+
+template <typename TDerived, typename TBase>
+void to_derived(const std::shared_ptr<TBase>&&) = delete;
+
+template <typename TBase, typename TDerived>
+void to_base(const std::shared_ptr<TDerived>&&) = delete;
+
+// Example: the shape hierarchy.
+
+struct shape
+{
+    virtual ~shape()
+    {
+    }
+
+    virtual int sides() const noexcept = 0;
+};
+
+struct rectangle : shape
+{
+    int sides() const noexcept override
+    {
+        return 4;
+    }
+};
+
+struct circle : shape
+{
+    int sides() const noexcept override
+    {
+        return 0;
+    }
+};
+
+template <typename TF>
+auto time_ms(TF&& f)
+{
+    auto start(std::chrono::high_resolution_clock::now());
+    f();
+    auto end(std::chrono::high_resolution_clock::now());
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main()
+{
+    // Basic usage (`unique_ptr`):
+    {
+        std::unique_ptr<shape> s(std::make_unique<circle>());
+
+        // Borrowed.
+        circle* c0{to_derived<circle>(s)};
+        assert(c0 == s.get());
+
+        // Transferred.
+        std::unique_ptr<circle> c1{to_derived<circle>(std::move(s))};
+        assert(s == nullptr && c1.get() == c0);
+        (void)c0;
+
+        std::unique_ptr<shape> s1{to_base<shape>(std::move(c1))};
+        assert(c1 == nullptr && s1->sides() == 0);
+
+        // Run-time assertion:
+        // to_derived<rectangle>(std::move(s1));
+    }
+
+    // Basic usage (`shared_ptr`):
+    {
+        std::shared_ptr<shape> s(std::make_shared<rectangle>());
+        auto copy(s);
+        assert(s.use_count() == 2);
+
+        // Borrowed: the reference count is left alone.
+        auto borrowed(to_derived<rectangle>(s));
+        assert(borrowed->sides() == 4 && s.use_count() == 2);
+        (void)borrowed;
+
+        // Transferred: ownership moves from `s` to `r`.
+        auto r(to_derived<rectangle>(std::move(s)));
+        assert(s == nullptr && r.use_count() == 2);
+
+        // Run-time assertion:
+        // to_derived<circle>(copy);
+    }
+
+    // Does not compile, as intended (no virtual destructor):
+    /*
+        struct base { };
+        struct derived : base { };
+
+        auto d(std::make_unique<derived>());
+        to_base<base>(std::move(d));
+    */
+
+    // Does not compile, as intended (borrowing from a const temporary):
+    /*
+        const std::shared_ptr<shape> s(std::make_shared<circle>());
+        circle* c{to_derived<circle>(std::move(s))};
+    */
+
+    // Casting a `shared_ptr` shared by several threads, for temporary uses.
+    // (Compile with optimizations enabled, and with `-DNDEBUG`, to get
+    // meaningful numbers.)
+    {
+        constexpr int iterations{2000000};
+        constexpr int thread_count{4};
+
+        const std::shared_ptr<shape> s(std::make_shared<rectangle>());
+
+        auto run([&](const char* name, auto&& f)
+            {
+                std::atomic<int> total{0};
+
+                auto ms(time_ms([&]
+                    {
+                        std::vector<std::thread> threads;
+                        for(int t{0}; t < thread_count; ++t)
+                        {
+                            threads.emplace_back([&]
+                                {
+                                    int sides{0};
+                                    for(int i{0}; i < iterations; ++i)
+                                    {
+                                        sides += f();
+                                    }
+
+                                    total += sides;
+                                });
+                        }
+
+                        for(auto& t : threads) t.join();
+                    }));
+
+                std::cout << name << ": " << ms << "ms (" << total
+                          << " sides)\n";
+            });
+
+        run("std::static_pointer_cast", [&]
+            {
+                return std::static_pointer_cast<rectangle>(s)->sides();
+            });
+
+        run("std::dynamic_pointer_cast", [&]
+            {
+                return std::dynamic_pointer_cast<rectangle>(s)->sides();
+            });
+
+        run("to_derived, borrowed", [&]
+            {
+                return to_derived<rectangle>(s)->sides();
+            });
+    }
+
+    return 0;
+}
@@ -0,0 +1,474 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "qualifier_utils.hpp"
+
+template <typename T, typename TStorage>
+constexpr decltype(auto) storage_cast(TStorage* storage) noexcept
+{
+    static_assert(sizeof(typename TStorage::type) >= sizeof(T), // .
+        "`TStorage` is not big enough for `T`.");
+
+    static_assert(alignof(typename TStorage::type) >= alignof(T), // .
+        "`TStorage` is not properly aligned for `T`.");
+
+    assert(storage != nullptr);
+
+    using return_type = copy_cv_qualifiers<T, TStorage>;
+    return reinterpret_cast<return_type*>(storage);
+}
+
+// `storage_cast` shines in containers that manage object lifetimes manually.
+// A classic example is a bounded multi-producer/multi-consumer queue, using
+// Dmitry Vyukov's per-slot sequence number design:
+// 1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+
+// Every slot stores a sequence number next to an aligned storage buffer.
+// Producers and consumers claim positions with a CAS on a shared counter, then
+// use the slot's sequence number to know whether the slot is ready for them.
+
+// Slots are padded to a cache line, so that threads working on neighbouring
+// slots do not invalidate each other's cache lines ("false sharing").
+
+// (C++17's `std::hardware_destructive_interference_size` is not reliably
+// available yet, so we hardcode the common value.)
+constexpr std::size_t cache_line_size{64};
+
+template <typename T, std::size_t TCapacity>
+class mpmc_queue
+{
+    // Power-of-two capacities allow us to use a mask instead of a modulo.
+    static_assert(TCapacity >= 2 && (TCapacity & (TCapacity - 1)) == 0, // .
+        "`TCapacity` must be a power of two greater than one.");
+
+private:
+    using storage_type = std::aligned_storage_t<sizeof(T), alignof(T)>;
+
+    struct alignas(cache_line_size) cell
+    {
+        std::atomic<std::size_t> _sequence;
+        storage_type _storage;
+    };
+
+    static constexpr std::size_t mask{TCapacity - 1};
+
+    std::unique_ptr<cell[]> _cells{std::make_unique<cell[]>(TCapacity)};
+
+    // The two counters live on separate cache lines as well.
+    alignas(cache_line_size) std::atomic<std::size_t> _enqueue_pos{0};
+    alignas(cache_line_size) std::atomic<std::size_t> _dequeue_pos{0};
+
+    // Claims a slot for a producer, returning `nullptr` if the queue is full.
+    auto claim_for_push() noexcept -> cell*
+    {
+        auto pos(_enqueue_pos.load(std::memory_order_relaxed));
+
+        while(true)
+        {
+            auto& c(_cells[pos & mask]);
+            auto seq(c._sequence.load(std::memory_order_acquire));
+            auto diff(static_cast<std::ptrdiff_t>(seq) -
+                      static_cast<std::ptrdiff_t>(pos));
+
+            // The slot is free for this lap: try to claim it.
+            if(diff == 0)
+            {
+                if(_enqueue_pos.compare_exchange_weak(
+                       pos, pos + 1, std::memory_order_relaxed))
+                {
+                    return &c;
+                }
+            }
+            // The slot still holds an element from the previous lap.
+            else if(diff < 0)
+            {
+                return nullptr;
+            }
+            // Another producer got here first.
+            else
+            {
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Claims a slot for a consumer, returning `nullptr` if the queue is empty.
+    auto claim_for_pop(std::size_t& pos) noexcept -> cell*
+    {
+        pos = _dequeue_pos.load(std::memory_order_relaxed);
+
+        while(true)
+        {
+            auto& c(_cells[pos & mask]);
+            auto seq(c._sequence.load(std::memory_order_acquire));
+            auto diff(static_cast<std::ptrdiff_t>(seq) -
+                      static_cast<std::ptrdiff_t>(pos + 1));
+
+            if(diff == 0)
+            {
+                if(_dequeue_pos.compare_exchange_weak(
+                       pos, pos + 1, std::memory_order_relaxed))
+                {
+                    return &c;
+                }
+            }
+            else if(diff < 0)
+            {
+                return nullptr;
+            }
+            else
+            {
+                pos = _dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Fills a claimed slot and publishes it. Nothing in here may throw: a
+    // slot that was claimed but never published would stall the queue.
+    template <typename... Ts>
+    bool emplace_nothrow(Ts&&... xs) noexcept
+    {
+        static_assert(std::is_nothrow_constructible<T, Ts&&...>{}, // .
+            "`T` must be nothrow move constructible.");
+
+        auto c(claim_for_push());
+        if(c == nullptr) return false;
+
+        auto pos(c->_sequence.load(std::memory_order_relaxed));
+
+        // `storage_cast` statically guarantees that the slot fits a `T`.
+        new(storage_cast<T>(&c->_storage)) T(std::forward<Ts>(xs)...);
+
+        // Publish the element to consumers.
+        c->_sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <typename... Ts>
+    bool emplace_impl(std::true_type, Ts&&... xs) noexcept
+    {
+        return emplace_nothrow(std::forward<Ts>(xs)...);
+    }
+
+    template <typename... Ts>
+    bool emplace_impl(std::false_type, Ts&&... xs)
+    {
+        // The constructor may throw: run it before claiming a slot, then move
+        // the result in.
+        T temp(std::forward<Ts>(xs)...);
+        return emplace_nothrow(std::move(temp));
+    }
+
+public:
+    mpmc_queue() noexcept
+    {
+        for(std::size_t i{0}; i < TCapacity; ++i)
+        {
+            _cells[i]._sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    mpmc_queue(const mpmc_queue&) = delete;
+    mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+    ~mpmc_queue()
+    {
+        // Destroy the elements that were never consumed.
+        std::size_t pos;
+        while(auto c = claim_for_pop(pos))
+        {
+            storage_cast<T>(&c->_storage)->~T();
+        }
+    }
+
+    template <typename... Ts>
+    bool try_emplace(Ts&&... xs)
+    {
+        return emplace_impl(std::is_nothrow_constructible<T, Ts&&...>{},
+            std::forward<Ts>(xs)...);
+    }
+
+    bool try_push(const T& x)
+    {
+        return try_emplace(x);
+    }
+
+    bool try_push(T&& x)
+    {
+        return try_emplace(std::move(x));
+    }
+
+    bool try_pop(T& out)
+    {
+        std::size_t pos;
+        auto c(claim_for_pop(pos));
+        if(c == nullptr) return false;
+
+        // Same as above: the slot must be handed back no matter what.
+        static_assert(std::is_nothrow_move_assignable<T>{}, // .
+            "`T` must be nothrow move assignable.");
+
+        auto ptr(storage_cast<T>(&c->_storage));
+        out = std::move(*ptr);
+        ptr->~T();
+
+        // Hand the slot back to producers, one lap later.
+        c->_sequence.store(pos + TCapacity, std::memory_order_release);
+        return true;
+    }
+};
+
+// To evaluate the queue, we compare it against the straightforward
+// `std::mutex` and `std::condition_variable` bounded queue it is meant to
+// replace.
+
+template <typename T, std::size_t TCapacity>
+class locked_queue
+{
+private:
+    std::queue<T> _queue;
+    std::mutex _mutex;
+    std::condition_variable _cv_not_full;
+    std::condition_variable _cv_not_empty;
+
+public:
+    void push(T x)
+    {
+        std::unique_lock<std::mutex> l{_mutex};
+        _cv_not_full.wait(l, [this]
+            {
+                return _queue.size() < TCapacity;
+            });
+
+        _queue.push(std::move(x));
+        l.unlock();
+        _cv_not_empty.notify_one();
+    }
+
+    T pop()
+    {
+        std::unique_lock<std::mutex> l{_mutex};
+        _cv_not_empty.wait(l, [this]
+            {
+                return !_queue.empty();
+            });
+
+        auto result(std::move(_queue.front()));
+        _queue.pop();
+        l.unlock();
+        _cv_not_full.notify_one();
+        return result;
+    }
+};
+
+// Runs `n_producers` and `n_consumers` threads, each producer pushing
+// `per_producer` integers. Returns the elapsed time in milliseconds and checks
+// that every pushed value was popped exactly once, via the total sum.
+template <typename TPush, typename TPop>
+auto run_fan_out(std::size_t n_producers, std::size_t n_consumers,
+    std::size_t per_producer, TPush&& push, TPop&& pop)
+{
+    const auto total(n_producers * per_producer);
+    std::atomic<std::size_t> popped{0};
+    std::atomic<std::size_t> sum{0};
+
+    std::vector<std::thread> threads;
+    auto start(std::chrono::high_resolution_clock::now());
+
+    for(std::size_t p{0}; p < n_producers; ++p)
+    {
+        threads.emplace_back([&, p]
+            {
+                for(std::size_t i{0}; i < per_producer; ++i)
+                {
+                    push(p * per_producer + i + 1);
+                }
+            });
+    }
+
+    for(std::size_t c{0}; c < n_consumers; ++c)
+    {
+        threads.emplace_back([&]
+            {
+                std::size_t x;
+                while(popped.load(std::memory_order_relaxed) < total)
+                {
+                    if(pop(x))
+                    {
+                        sum += x;
+                        ++popped;
+                    }
+                }
+            });
+    }
+
+    for(auto& t : threads) t.join();
+    auto end(std::chrono::high_resolution_clock::now());
+
+    assert(sum == total * (total + 1) / 2);
+    (void)sum;
+
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void benchmark(std::size_t n_threads, std::size_t per_producer)
+{
+    constexpr std::size_t capacity{1024};
+
+    auto lf_queue(std::make_unique<mpmc_queue<std::size_t, capacity>>());
+    auto lf_ms(run_fan_out(n_threads, n_threads, per_producer,
+        [&](std::size_t x)
+        {
+            while(!lf_queue->try_push(x)) std::this_thread::yield();
+        },
+        [&](std::size_t& x)
+        {
+            if(lf_queue->try_pop(x)) return true;
+            std::this_thread::yield();
+            return false;
+        }));
+
+    // The locked queue's `pop` blocks, so every consumer must be handed an
+    // exact share of the elements.
+    locked_queue<std::size_t, capacity> mx_queue;
+    std::atomic<std::size_t> claimed{0};
+    const auto total(n_threads * per_producer);
+
+    auto mx_ms(run_fan_out(n_threads, n_threads, per_producer,
+        [&](std::size_t x)
+        {
+            mx_queue.push(x);
+        },
+        [&](std::size_t& x)
+        {
+            if(claimed++ >= total) return false;
+            x = mx_queue.pop();
+            return true;
+        }));
+
+    std::cout << n_threads << "P/" << n_threads << "C: "
+              << "lock-free " << lf_ms << "ms, "
+              << "mutex+cv " << mx_ms << "ms\n";
+}
+
+int main()
+{
+    // Basic usage:
+    {
+        mpmc_queue<int, 4> q;
+        int x;
+
+        // The results are stored before being checked, so that the
+        // operations still run with `NDEBUG` defined.
+        bool ok{q.try_pop(x)};
+        assert(!ok);
+
+        for(int i{1}; i <= 4; ++i)
+        {
+            ok = q.try_push(i);
+            assert(ok);
+        }
+
+        // The queue is bounded:
+        ok = q.try_push(5);
+        assert(!ok);
+
+        ok = q.try_pop(x);
+        assert(ok && x == 1);
+
+        ok = q.try_push(5);
+        assert(ok);
+
+        for(int i{2}; i <= 5; ++i)
+        {
+            ok = q.try_pop(x);
+            assert(ok && x == i);
+        }
+
+        ok = q.try_pop(x);
+        assert(!ok);
+        (void)ok;
+    }
+
+    // Non-trivial element types are constructed and destroyed in place:
+    {
+        mpmc_queue<std::unique_ptr<int>, 2> q;
+        bool ok{q.try_emplace(std::make_unique<int>(10))};
+        assert(ok);
+
+        std::unique_ptr<int> out;
+        ok = q.try_pop(out);
+        assert(ok && *out == 10);
+
+        // Elements left in the queue are destroyed with it.
+        ok = q.try_emplace(std::make_unique<int>(20));
+        assert(ok);
+        (void)ok;
+    }
+
+    // Constructors that may throw run before a slot is claimed, so a throwing
+    // constructor cannot leave an unpublished slot behind:
+    {
+        struct may_throw
+        {
+            int _x;
+
+            may_throw(int x) : _x{x}
+            {
+                if(x < 0) throw std::invalid_argument{"negative"};
+            }
+        };
+
+        mpmc_queue<may_throw, 2> q;
+
+        try
+        {
+            q.try_emplace(-1);
+            assert(false);
+        }
+        catch(const std::invalid_argument&)
+        {
+        }
+
+        bool ok{q.try_emplace(1)};
+        assert(ok);
+
+        may_throw out{0};
+        ok = q.try_pop(out);
+        assert(ok && out._x == 1);
+        (void)ok;
+    }
+
+    // Throughput, from 1 to N producers and consumers.
+    // (Compile with optimizations enabled to get meaningful numbers.)
+    {
+        const std::size_t max_threads{std::max(
+            2u, std::thread::hardware_concurrency() / 2)};
+
+        for(std::size_t n{1}; n <= max_threads; n *= 2)
+        {
+            benchmark(n, 100000 / n);
+        }
+    }
+
+    return 0;
+}
+
+// The lock-free queue never blocks: when it's full or empty, `try_push` and
+// `try_pop` return `false` and the caller decides whether to spin, yield or do
+// other work.
\ No newline at end of file
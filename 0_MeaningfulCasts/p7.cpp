@@ -0,0 +1,236 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+#include "qualifier_utils.hpp"
+
+template <typename T, typename TStorage>
+constexpr decltype(auto) storage_cast(TStorage* storage) noexcept
+{
+    static_assert(sizeof(typename TStorage::type) >= sizeof(T), // .
+        "`TStorage` is not big enough for `T`.");
+
+    static_assert(alignof(typename TStorage::type) >= alignof(T), // .
+        "`TStorage` is not properly aligned for `T`.");
+
+    assert(storage != nullptr);
+
+    using return_type = copy_cv_qualifiers<T, TStorage>;
+    return reinterpret_cast<return_type*>(storage);
+}
+
+// Read-mostly state, such as configuration or metrics snapshots, is often
+// protected by a `std::shared_mutex`. Even a shared lock writes to the mutex's
+// cache line, though, and with many readers that line bounces between cores.
+
+// A "sequence lock" avoids that: readers only *read* a counter, copy the
+// value, and read the counter again. If the counter changed (or was odd,
+// meaning that a write was in progress) the copy is discarded and retried.
+
+// Since readers may copy a value while it's being overwritten, the stored type
+// must be trivially copyable - torn copies are simply thrown away.
+
+template <typename T>
+class seqlock_cell
+{
+    static_assert(std::is_trivially_copyable<T>{}, // .
+        "`T` must be trivially copyable.");
+
+private:
+    std::atomic<std::size_t> _sequence{0};
+    std::aligned_storage_t<sizeof(T), alignof(T)> _storage;
+
+public:
+    seqlock_cell(const T& x = T{}) noexcept
+    {
+        new(storage_cast<T>(&_storage)) T(x);
+    }
+
+    seqlock_cell(const seqlock_cell&) = delete;
+    seqlock_cell& operator=(const seqlock_cell&) = delete;
+
+    // Writers never wait for readers. Concurrent writers serialize among
+    // themselves by moving the counter from even to odd with a CAS.
+    void store(const T& x) noexcept
+    {
+        auto seq(_sequence.load(std::memory_order_relaxed));
+
+        while(true)
+        {
+            if((seq & 1) == 0 &&
+                _sequence.compare_exchange_weak(
+                    seq, seq + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+
+            seq = _sequence.load(std::memory_order_relaxed);
+        }
+
+        // Prevent the payload writes from being reordered before the counter
+        // becomes odd.
+        std::atomic_thread_fence(std::memory_order_release);
+
+        std::memcpy(storage_cast<T>(&_storage), &x, sizeof(T));
+
+        // Publish the new value.
+        _sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    // Readers never write to shared memory.
+    auto load() const noexcept
+    {
+        std::aligned_storage_t<sizeof(T), alignof(T)> result;
+
+        while(true)
+        {
+            auto seq0(_sequence.load(std::memory_order_acquire));
+            if(seq0 & 1) continue;
+
+            std::memcpy(storage_cast<T>(&result), storage_cast<T>(&_storage),
+                sizeof(T));
+
+            // Prevent the payload reads from being reordered after the second
+            // counter read.
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if(_sequence.load(std::memory_order_relaxed) == seq0) break;
+        }
+
+        return *storage_cast<T>(&result);
+    }
+};
+
+// (Strictly speaking, the racing `memcpy` is a data race according to the
+// C++ memory model. This is the same trade-off made by every practical seqlock
+// implementation, including the Linux kernel's - see Hans Boehm's "Can
+// Seqlocks Get Along With Programming Language Memory Models?".)
+
+struct metrics
+{
+    std::size_t requests;
+    std::size_t errors;
+    double avg_latency;
+    double max_latency;
+};
+
+// The alternative we're replacing.
+template <typename T>
+class shared_mutex_cell
+{
+private:
+    mutable std::shared_mutex _mutex;
+    T _value;
+
+public:
+    void store(const T& x)
+    {
+        std::unique_lock<std::shared_mutex> l{_mutex};
+        _value = x;
+    }
+
+    auto load() const
+    {
+        std::shared_lock<std::shared_mutex> l{_mutex};
+        return _value;
+    }
+};
+
+// Runs `n_readers` threads for `duration`, while a writer updates the cell
+// every millisecond. Returns the total number of completed reads.
+template <typename TCell>
+auto benchmark_reads(TCell& cell, std::size_t n_readers,
+    std::chrono::milliseconds duration)
+{
+    std::atomic<bool> running{true};
+    std::atomic<std::size_t> total_reads{0};
+    std::vector<std::thread> threads;
+
+    threads.emplace_back([&]
+        {
+            std::size_t i{0};
+            while(running)
+            {
+                ++i;
+                cell.store(metrics{i, i, double(i), double(i)});
+                std::this_thread::sleep_for(std::chrono::milliseconds{1});
+            }
+        });
+
+    for(std::size_t r{0}; r < n_readers; ++r)
+    {
+        threads.emplace_back([&]
+            {
+                std::size_t reads{0};
+                while(running)
+                {
+                    auto m(cell.load());
+
+                    // Every snapshot must be consistent.
+                    assert(m.requests == m.errors);
+                    (void)m;
+
+                    ++reads;
+                }
+
+                total_reads += reads;
+            });
+    }
+
+    std::this_thread::sleep_for(duration);
+    running = false;
+
+    for(auto& t : threads) t.join();
+    return total_reads.load();
+}
+
+int main()
+{
+    // Basic usage:
+    {
+        seqlock_cell<int> c{10};
+        assert(c.load() == 10);
+
+        c.store(20);
+        assert(c.load() == 20);
+    }
+
+    // Does not compile, as intended:
+    /*
+        seqlock_cell<std::vector<int>> c;
+    */
+
+    // Read throughput with many readers.
+    // (Compile with optimizations enabled to get meaningful numbers.)
+    {
+        const std::chrono::milliseconds duration{200};
+        const std::size_t max_readers{
+            std::max(4u, std::thread::hardware_concurrency())};
+
+        for(std::size_t n{1}; n <= max_readers; n *= 2)
+        {
+            seqlock_cell<metrics> sl_cell{metrics{}};
+            shared_mutex_cell<metrics> sm_cell;
+
+            auto sl_reads(benchmark_reads(sl_cell, n, duration));
+            auto sm_reads(benchmark_reads(sm_cell, n, duration));
+
+            std::cout << n << " readers: seqlock " << sl_reads
+                      << " reads, shared_mutex " << sm_reads << " reads\n";
+        }
+    }
+
+    return 0;
+}
\ No newline at end of file
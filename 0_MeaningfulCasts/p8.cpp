@@ -0,0 +1,316 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <string>
+#include <sys/mman.h>
+#include "qualifier_utils.hpp"
+
+template <typename T, typename TStorage>
+constexpr decltype(auto) storage_cast(TStorage* storage) noexcept
+{
+    static_assert(sizeof(typename TStorage::type) >= sizeof(T), // .
+        "`TStorage` is not big enough for `T`.");
+
+    static_assert(alignof(typename TStorage::type) >= alignof(T), // .
+        "`TStorage` is not properly aligned for `T`.");
+
+    assert(storage != nullptr);
+
+    using return_type = copy_cv_qualifiers<T, TStorage>;
+    return reinterpret_cast<return_type*>(storage);
+}
+
+// Big in-memory tables accessed randomly are often dominated by TLB misses:
+// with 4KB pages, every few accesses require a page table walk.
+
+// Linux offers two ways of getting 2MB "huge" pages:
+//
+// * `mmap(MAP_HUGETLB)`, which requires pages reserved in advance through
+//   `hugetlbfs` (`/proc/sys/vm/nr_hugepages`);
+//
+// * `madvise(MADV_HUGEPAGE)` on a normal mapping, which asks the kernel's
+//   "transparent huge pages" machinery to back the range with huge pages when
+//   possible.
+
+// The arena below tries the first option, transparently falls back to the
+// second, and reports what it got. (This code segment is Linux-specific.)
+
+constexpr std::size_t huge_page_size{2 * 1024 * 1024};
+
+enum class page_backing
+{
+    hugetlb,
+    transparent_huge,
+    small,
+    none
+};
+
+auto to_string(page_backing x) noexcept
+{
+    switch(x)
+    {
+        case page_backing::hugetlb: return "hugetlbfs";
+        case page_backing::transparent_huge: return "transparent huge pages";
+        case page_backing::small: return "4KB pages";
+        case page_backing::none: return "nothing (mapping failed)";
+    }
+
+    return "unknown";
+}
+
+namespace impl
+{
+    constexpr auto round_up(std::size_t x, std::size_t multiple) noexcept
+    {
+        return (x + multiple - 1) / multiple * multiple;
+    }
+
+    // A successful `madvise(MADV_HUGEPAGE)` only means that the kernel
+    // accepted the hint: with THP set to "never", nothing will ever be backed
+    // by huge pages. The active mode is the bracketed one, e.g.
+    // "always [madvise] never".
+    inline bool transparent_huge_pages_enabled()
+    {
+        std::ifstream f{"/sys/kernel/mm/transparent_hugepage/enabled"};
+        std::string modes;
+        if(!std::getline(f, modes)) return false;
+
+        return modes.find("[always]") != std::string::npos ||
+               modes.find("[madvise]") != std::string::npos;
+    }
+}
+
+class huge_page_arena
+{
+private:
+    void* _mapping{MAP_FAILED};
+    std::size_t _mapping_size{0};
+    std::byte* _begin{nullptr};
+    std::size_t _capacity{0};
+    std::size_t _used{0};
+    page_backing _backing{page_backing::small};
+
+    bool try_hugetlb(std::size_t size) noexcept
+    {
+#ifdef MAP_HUGETLB
+        _mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if(_mapping == MAP_FAILED) return false;
+
+        _mapping_size = size;
+        _begin = static_cast<std::byte*>(_mapping);
+        _backing = page_backing::hugetlb;
+        return true;
+#else
+        (void)size;
+        return false;
+#endif
+    }
+
+    void map_normal(std::size_t size, bool allow_huge)
+    {
+        // Over-reserve by one huge page, so that the usable range can start
+        // on a huge page boundary.
+        _mapping_size = size + huge_page_size;
+        _mapping = mmap(nullptr, _mapping_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        // Not only a debug-time concern: leave the arena empty, so that
+        // every allocation fails with `nullptr`.
+        if(_mapping == MAP_FAILED)
+        {
+            _mapping_size = 0;
+            _capacity = 0;
+            _backing = page_backing::none;
+            return;
+        }
+
+        auto address(reinterpret_cast<std::uintptr_t>(_mapping));
+        _begin = reinterpret_cast<std::byte*>(
+            impl::round_up(address, huge_page_size));
+
+#if defined(MADV_HUGEPAGE) && defined(MADV_NOHUGEPAGE)
+        if(allow_huge && madvise(_begin, size, MADV_HUGEPAGE) == 0 &&
+            impl::transparent_huge_pages_enabled())
+        {
+            _backing = page_backing::transparent_huge;
+            return;
+        }
+
+        // Explicitly opt out, so that 4KB measurements are not skewed by a
+        // system-wide "always" THP setting.
+        madvise(_begin, size, MADV_NOHUGEPAGE);
+#else
+        (void)allow_huge;
+#endif
+
+        _backing = page_backing::small;
+    }
+
+public:
+    // If `allow_huge` is `false`, the arena is always backed by normal pages.
+    // This is mostly useful for benchmarking.
+    // If no memory could be mapped at all, `backing()` is
+    // `page_backing::none` and the capacity is zero.
+    huge_page_arena(std::size_t capacity, bool allow_huge = true)
+        : _capacity{impl::round_up(capacity, huge_page_size)}
+    {
+        if(!allow_huge || !try_hugetlb(_capacity))
+        {
+            map_normal(_capacity, allow_huge);
+        }
+    }
+
+    huge_page_arena(const huge_page_arena&) = delete;
+    huge_page_arena& operator=(const huge_page_arena&) = delete;
+
+    ~huge_page_arena()
+    {
+        if(_mapping != MAP_FAILED) munmap(_mapping, _mapping_size);
+    }
+
+    auto backing() const noexcept
+    {
+        return _backing;
+    }
+
+    auto capacity() const noexcept
+    {
+        return _capacity;
+    }
+
+    auto used() const noexcept
+    {
+        return _used;
+    }
+
+    // Hands out uninitialized, correctly aligned storage for `n` objects of
+    // type `T`, or `nullptr` if the arena is exhausted.
+    template <typename T>
+    auto allocate(std::size_t n = 1) noexcept -> T*
+    {
+        using slot_type = std::aligned_storage_t<sizeof(T), alignof(T)>;
+
+        // Huge pages are aligned to 2MB, which is more than enough for any
+        // reasonable `T`.
+        static_assert(alignof(slot_type) <= huge_page_size, // .
+            "`T`'s alignment is bigger than the page size.");
+
+        // Checked without computing `sizeof(slot_type) * n`, which could
+        // overflow for huge `n`.
+        auto offset(impl::round_up(_used, alignof(slot_type)));
+        if(offset > _capacity || n > (_capacity - offset) / sizeof(slot_type))
+        {
+            return nullptr;
+        }
+
+        _used = offset + sizeof(slot_type) * n;
+
+        // `storage_cast` checks size and alignment at compile-time.
+        auto slot(reinterpret_cast<slot_type*>(_begin + offset));
+        return storage_cast<T>(slot);
+    }
+
+    template <typename T, typename... Ts>
+    auto create(Ts&&... xs) -> T*
+    {
+        auto ptr(allocate<T>());
+        if(ptr == nullptr) return nullptr;
+
+        return new(ptr) T(std::forward<Ts>(xs)...);
+    }
+};
+
+// Measures random accesses over a table of `n` integers stored in `arena`.
+auto benchmark_random_access(huge_page_arena& arena, std::size_t n)
+{
+    auto table(arena.allocate<std::uint64_t>(n));
+    if(table == nullptr)
+    {
+        std::cout << to_string(arena.backing()) << ": not enough memory\n";
+        return;
+    }
+
+    for(std::size_t i{0}; i < n; ++i) table[i] = i;
+
+    std::minstd_rand rng{1234};
+    std::uniform_int_distribution<std::size_t> dist{0, n - 1};
+    std::uint64_t sum{0};
+
+    auto start(std::chrono::high_resolution_clock::now());
+    for(std::size_t i{0}; i < 5000000; ++i) sum += table[dist(rng)];
+    auto end(std::chrono::high_resolution_clock::now());
+
+    std::cout << to_string(arena.backing()) << ": "
+              << std::chrono::duration<double, std::milli>(end - start).count()
+              << "ms (checksum " << sum << ")\n";
+}
+
+int main()
+{
+    // Typed, aligned slots:
+    {
+        huge_page_arena a{1024};
+        std::cout << "arena backed by " << to_string(a.backing()) << "\n";
+
+        auto c(a.create<char>('a'));
+        auto d(a.create<double>(10.0));
+        auto i(a.create<int>(5));
+
+        assert(*c == 'a' && *d == 10.0 && *i == 5);
+        assert(reinterpret_cast<std::uintptr_t>(d) % alignof(double) == 0);
+        assert(a.capacity() == huge_page_size);
+        (void)c;
+        (void)d;
+        (void)i;
+    }
+
+    // Exhaustion is reported with `nullptr`:
+    {
+        huge_page_arena a{huge_page_size};
+
+        auto all(a.allocate<char>(huge_page_size));
+        auto one_more(a.allocate<char>());
+
+        assert(all != nullptr && one_more == nullptr);
+        (void)all;
+        (void)one_more;
+
+        // Sizes that would overflow are rejected too.
+        huge_page_arena b{huge_page_size};
+        auto huge(b.allocate<std::uint64_t>(
+            std::numeric_limits<std::size_t>::max() / 4));
+        assert(huge == nullptr && b.used() == 0);
+        (void)huge;
+    }
+
+    // Random access over a 512MB table, 4KB pages vs huge pages.
+    // (Compile with optimizations enabled to get meaningful numbers.)
+    {
+        constexpr std::size_t n{64 * 1024 * 1024};
+        constexpr auto bytes(n * sizeof(std::uint64_t));
+
+        {
+            huge_page_arena small{bytes, false};
+            benchmark_random_access(small, n);
+        }
+
+        {
+            huge_page_arena huge{bytes};
+            benchmark_random_access(huge, n);
+        }
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,617 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <type_traits>
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "qualifier_utils.hpp"
+
+template <typename T, typename TStorage>
+constexpr decltype(auto) storage_cast(TStorage* storage) noexcept
+{
+    static_assert(sizeof(typename TStorage::type) >= sizeof(T), // .
+        "`TStorage` is not big enough for `T`.");
+
+    static_assert(alignof(typename TStorage::type) >= alignof(T), // .
+        "`TStorage` is not properly aligned for `T`.");
+
+    assert(storage != nullptr);
+
+    using return_type = copy_cv_qualifiers<T, TStorage>;
+    return reinterpret_cast<return_type*>(storage);
+}
+
+// Optional and variant types are the textbook users of aligned storage. Let's
+// build minimal versions of both on top of `storage_cast`.
+
+// The interesting part is making them "as trivial as their contents": when
+// every alternative is trivially copyable and destructible, the wrapper's
+// special member functions should be defaulted. That makes the wrapper itself
+// trivially copyable, which means that it can be passed in registers, and that
+// arrays of it can be copied in bulk with `memcpy`.
+
+// Special members cannot be conditionally defaulted directly, so we pick one
+// of two storage base classes depending on a compile-time predicate.
+
+template <typename... Ts>
+constexpr bool all_trivial{
+    (std::is_trivially_copyable<Ts>{} && ...) &&
+    (std::is_trivially_destructible<Ts>{} && ...)};
+
+namespace impl
+{
+    template <typename T, bool TTrivial = all_trivial<T>>
+    struct opt_storage;
+
+    // Trivial case: everything is defaulted.
+    template <typename T>
+    struct opt_storage<T, true>
+    {
+        std::aligned_storage_t<sizeof(T), alignof(T)> _storage;
+        bool _engaged{false};
+
+        void destroy() noexcept
+        {
+            _engaged = false;
+        }
+    };
+
+    // Non-trivial case: the special members must manage the lifetime of the
+    // contained object.
+    template <typename T>
+    struct opt_storage<T, false>
+    {
+        std::aligned_storage_t<sizeof(T), alignof(T)> _storage;
+        bool _engaged{false};
+
+        opt_storage() = default;
+
+        opt_storage(const opt_storage& rhs)
+        {
+            if(rhs._engaged) construct_from(*storage_cast<T>(&rhs._storage));
+        }
+
+        opt_storage(opt_storage&& rhs) noexcept(
+            std::is_nothrow_move_constructible<T>{})
+        {
+            if(rhs._engaged)
+            {
+                construct_from(std::move(*storage_cast<T>(&rhs._storage)));
+            }
+        }
+
+        opt_storage& operator=(const opt_storage& rhs)
+        {
+            if(this == &rhs) return *this;
+
+            destroy();
+            if(rhs._engaged) construct_from(*storage_cast<T>(&rhs._storage));
+            return *this;
+        }
+
+        opt_storage& operator=(opt_storage&& rhs) noexcept(
+            std::is_nothrow_move_constructible<T>{})
+        {
+            if(this == &rhs) return *this;
+
+            destroy();
+            if(rhs._engaged)
+            {
+                construct_from(std::move(*storage_cast<T>(&rhs._storage)));
+            }
+
+            return *this;
+        }
+
+        ~opt_storage()
+        {
+            destroy();
+        }
+
+        template <typename TX>
+        void construct_from(TX&& x)
+        {
+            new(storage_cast<T>(&_storage)) T(std::forward<TX>(x));
+            _engaged = true;
+        }
+
+        void destroy() noexcept
+        {
+            if(!_engaged) return;
+
+            storage_cast<T>(&_storage)->~T();
+            _engaged = false;
+        }
+    };
+}
+
+template <typename T>
+class opt : private impl::opt_storage<T>
+{
+private:
+    using base_type = impl::opt_storage<T>;
+
+public:
+    opt() = default;
+
+    opt(const T& x)
+    {
+        emplace(x);
+    }
+
+    opt(T&& x)
+    {
+        emplace(std::move(x));
+    }
+
+    template <typename... Ts>
+    auto& emplace(Ts&&... xs)
+    {
+        reset();
+
+        auto ptr(new(storage_cast<T>(&this->_storage))
+                T(std::forward<Ts>(xs)...));
+
+        this->_engaged = true;
+        return *ptr;
+    }
+
+    void reset() noexcept
+    {
+        base_type::destroy();
+    }
+
+    auto has_value() const noexcept
+    {
+        return this->_engaged;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return has_value();
+    }
+
+    auto& operator*() noexcept
+    {
+        assert(has_value());
+        return *storage_cast<T>(&this->_storage);
+    }
+
+    const auto& operator*() const noexcept
+    {
+        assert(has_value());
+        return *storage_cast<T>(&this->_storage);
+    }
+
+    auto operator-> () noexcept
+    {
+        return &**this;
+    }
+
+    auto operator-> () const noexcept
+    {
+        return &**this;
+    }
+};
+
+// The variant follows the same strategy. The index of the active alternative
+// is stored in a single byte, just like a hand-rolled tagged union would do.
+
+namespace impl
+{
+    template <typename T, typename... Ts>
+    struct index_of;
+
+    template <typename T, typename... Ts>
+    struct index_of<T, T, Ts...> : std::integral_constant<std::size_t, 0>
+    {
+    };
+
+    template <typename T, typename TFirst, typename... Ts>
+    struct index_of<T, TFirst, Ts...>
+        : std::integral_constant<std::size_t, 1 + index_of<T, Ts...>{}>
+    {
+    };
+
+    template <typename T, typename... Ts>
+    struct first
+    {
+        using type = T;
+    };
+
+    template <typename... Ts>
+    using var_storage_type = std::aligned_storage_t< // .
+        std::max({sizeof(Ts)...}), std::max({alignof(Ts)...})>;
+
+    // Type-erased operations, one per alternative, used to build tables
+    // indexed by the active alternative's index.
+    template <typename T, typename TStorage>
+    void destroy_as(TStorage* s) noexcept
+    {
+        storage_cast<T>(s)->~T();
+    }
+
+    template <typename T, typename TStorage>
+    void copy_as(TStorage* dst, const TStorage* src)
+    {
+        new(storage_cast<T>(dst)) T(*storage_cast<T>(src));
+    }
+
+    template <typename T, typename TStorage>
+    void move_as(TStorage* dst, TStorage* src)
+    {
+        new(storage_cast<T>(dst)) T(std::move(*storage_cast<T>(src)));
+    }
+
+    // If constructing a new alternative throws, the old one is already gone:
+    // the variant is then "valueless", and must not destroy anything.
+    constexpr unsigned char var_valueless{255};
+
+    template <bool TTrivial, typename... Ts>
+    struct var_base;
+
+    template <typename... Ts>
+    struct var_base<true, Ts...>
+    {
+        var_storage_type<Ts...> _storage;
+        unsigned char _index;
+
+        void destroy() noexcept
+        {
+        }
+    };
+
+    template <typename... Ts>
+    struct var_base<false, Ts...>
+    {
+        using storage_type = var_storage_type<Ts...>;
+
+        storage_type _storage;
+        unsigned char _index;
+
+        var_base() = default;
+
+        var_base(const var_base& rhs)
+        {
+            copy_from(rhs);
+        }
+
+        var_base(var_base&& rhs) noexcept(
+            (std::is_nothrow_move_constructible<Ts>{} && ...))
+        {
+            move_from(rhs);
+        }
+
+        var_base& operator=(const var_base& rhs)
+        {
+            if(this == &rhs) return *this;
+
+            destroy();
+            copy_from(rhs);
+            return *this;
+        }
+
+        var_base& operator=(var_base&& rhs) noexcept(
+            (std::is_nothrow_move_constructible<Ts>{} && ...))
+        {
+            if(this == &rhs) return *this;
+
+            destroy();
+            move_from(rhs);
+            return *this;
+        }
+
+        ~var_base()
+        {
+            destroy();
+        }
+
+        // The index is only set once the copy or move has succeeded.
+        void copy_from(const var_base& rhs)
+        {
+            _index = var_valueless;
+            if(rhs._index == var_valueless) return;
+
+            using fn_type = void (*)(storage_type*, const storage_type*);
+            constexpr fn_type table[]{&copy_as<Ts, storage_type>...};
+            table[rhs._index](&_storage, &rhs._storage);
+            _index = rhs._index;
+        }
+
+        void move_from(var_base& rhs)
+        {
+            _index = var_valueless;
+            if(rhs._index == var_valueless) return;
+
+            using fn_type = void (*)(storage_type*, storage_type*);
+            constexpr fn_type table[]{&move_as<Ts, storage_type>...};
+            table[rhs._index](&_storage, &rhs._storage);
+            _index = rhs._index;
+        }
+
+        void destroy() noexcept
+        {
+            if(_index == var_valueless) return;
+
+            using fn_type = void (*)(storage_type*);
+            constexpr fn_type table[]{&destroy_as<Ts, storage_type>...};
+            table[_index](&_storage);
+            _index = var_valueless;
+        }
+    };
+}
+
+template <typename... Ts>
+class var : private impl::var_base<all_trivial<Ts...>, Ts...>
+{
+    // Index 255 is reserved for the valueless state.
+    static_assert(sizeof...(Ts) > 0 && sizeof...(Ts) < 256, // .
+        "`var` must have between 1 and 255 alternatives.");
+
+private:
+    using base_type = impl::var_base<all_trivial<Ts...>, Ts...>;
+    using storage_type = impl::var_storage_type<Ts...>;
+
+    template <typename T>
+    static constexpr auto index_of = impl::index_of<T, Ts...>::value;
+
+    template <typename TF, typename TResult, typename T>
+    static TResult visit_as(storage_type* s, TF& f)
+    {
+        return f(*storage_cast<T>(s));
+    }
+
+public:
+    // Default-constructs the first alternative.
+    var()
+    {
+        using first = typename impl::first<Ts...>::type;
+        new(storage_cast<first>(&this->_storage)) first{};
+        this->_index = 0;
+    }
+
+    template <typename T,
+        typename TDecayed = std::decay_t<T>,
+        typename = std::enable_if_t<!std::is_same<TDecayed, var>{}>>
+    var(T&& x)
+    {
+        new(storage_cast<TDecayed>(&this->_storage))
+            TDecayed(std::forward<T>(x));
+
+        this->_index = index_of<TDecayed>;
+    }
+
+    template <typename T, typename... TArgs>
+    auto& emplace(TArgs&&... xs)
+    {
+        base_type::destroy();
+        this->_index = impl::var_valueless;
+
+        auto ptr(new(storage_cast<T>(&this->_storage))
+                T(std::forward<TArgs>(xs)...));
+
+        this->_index = index_of<T>;
+        return *ptr;
+    }
+
+    // Only possible after an `emplace` that threw.
+    auto valueless() const noexcept
+    {
+        return this->_index == impl::var_valueless;
+    }
+
+    auto index() const noexcept
+    {
+        return static_cast<std::size_t>(this->_index);
+    }
+
+    template <typename T>
+    auto holds() const noexcept
+    {
+        return this->_index == index_of<T>;
+    }
+
+    template <typename T>
+    auto& get() noexcept
+    {
+        assert(holds<T>());
+        return *storage_cast<T>(&this->_storage);
+    }
+
+    template <typename T>
+    const auto& get() const noexcept
+    {
+        assert(holds<T>());
+        return *storage_cast<T>(&this->_storage);
+    }
+
+    // Calls `f` with the active alternative, through a table of function
+    // pointers. All branches must return the same type.
+    template <typename TF>
+    decltype(auto) visit(TF&& f)
+    {
+        using first = typename impl::first<Ts...>::type;
+        using result_type = decltype(f(std::declval<first&>()));
+        using fn_type = result_type (*)(storage_type*, TF&);
+
+        constexpr fn_type table[]{&visit_as<TF, result_type, Ts>...};
+        assert(!valueless());
+        return table[this->_index](&this->_storage, f);
+    }
+};
+
+// Both types are exactly as trivial as their contents:
+
+static_assert(std::is_trivially_copyable<opt<int>>{}, "");
+static_assert(std::is_trivially_destructible<opt<int>>{}, "");
+static_assert(!std::is_trivially_copyable<opt<std::string>>{}, "");
+
+static_assert(std::is_trivially_copyable<var<int, float, char>>{}, "");
+static_assert(std::is_trivially_destructible<var<int, float, char>>{}, "");
+static_assert(!std::is_trivially_copyable<var<int, std::string>>{}, "");
+
+// ...and their layout matches a hand-rolled tagged union:
+
+static_assert(sizeof(var<int, float, char>) == 2 * sizeof(int), "");
+
+// Let's compare against the kind of hand-rolled tagged union found in hot
+// message structs, whose copy constructor switches on the tag.
+
+struct legacy_message
+{
+    enum class kind : unsigned char
+    {
+        integer,
+        real,
+        character
+    };
+
+    kind _kind;
+    union
+    {
+        int _i;
+        float _f;
+        char _c;
+    };
+
+    legacy_message() : _kind{kind::integer}, _i{0}
+    {
+    }
+
+    legacy_message(const legacy_message& rhs) : _kind{rhs._kind}
+    {
+        switch(_kind)
+        {
+            case kind::integer: _i = rhs._i; break;
+            case kind::real: _f = rhs._f; break;
+            case kind::character: _c = rhs._c; break;
+        }
+    }
+
+    legacy_message& operator=(const legacy_message& rhs)
+    {
+        new(this) legacy_message(rhs);
+        return *this;
+    }
+};
+
+using message = var<int, float, char>;
+
+template <typename T>
+auto benchmark_bulk_copy(const char* name, std::size_t n)
+{
+    std::vector<T> src(n), dst(n);
+
+    auto start(std::chrono::high_resolution_clock::now());
+    for(int i{0}; i < 20; ++i)
+    {
+        // For trivially copyable types, `std::copy` lowers to `memmove`.
+        std::copy(src.begin(), src.end(), dst.begin());
+    }
+    auto end(std::chrono::high_resolution_clock::now());
+
+    std::cout << name << ": "
+              << std::chrono::duration<double, std::milli>(end - start).count()
+              << "ms\n";
+}
+
+int main()
+{
+    // `opt` usage:
+    {
+        opt<int> o;
+        assert(!o);
+
+        o.emplace(10);
+        assert(o && *o == 10);
+
+        auto o2(o);
+        o.reset();
+        assert(!o && *o2 == 10);
+    }
+
+    {
+        opt<std::string> o{std::string{"hello"}};
+        auto o2(o);
+        auto o3(std::move(o));
+
+        assert(*o2 == "hello" && *o3 == "hello");
+        assert(o2->size() == 5);
+    }
+
+    // `var` usage:
+    {
+        message m;
+        assert(m.holds<int>() && m.get<int>() == 0);
+
+        m = message{2.5f};
+        assert(m.holds<float>() && m.get<float>() == 2.5f);
+
+        // Trivially copyable variants can be copied with `memcpy`.
+        message m2;
+        std::memcpy(&m2, &m, sizeof(message));
+        assert(m2.holds<float>() && m2.get<float>() == 2.5f);
+
+        m2.emplace<char>('x');
+        assert(m2.visit([](auto x)
+                   {
+                       return static_cast<int>(x);
+                   }) == 'x');
+    }
+
+    {
+        var<int, std::string> v{std::string{"hello"}};
+        auto v2(v);
+
+        v.emplace<int>(10);
+        assert(v.get<int>() == 10);
+        assert(v2.get<std::string>() == "hello");
+
+        // A throwing constructor leaves the variant valueless, so that the
+        // old alternative isn't destroyed twice.
+        try
+        {
+            v2.emplace<std::string>(std::string::npos, 'x');
+            assert(false);
+        }
+        catch(const std::length_error&)
+        {
+            assert(v2.valueless());
+        }
+
+        auto v3(v2);
+        assert(v3.valueless());
+
+        v2 = v;
+        assert(v2.get<int>() == 10);
+    }
+
+    // Moves are `noexcept` when every alternative's are, so containers of
+    // variants move, rather than copy, on reallocation:
+    static_assert(
+        std::is_nothrow_move_constructible<var<int, std::string>>{}, "");
+
+    // Run-time assertion:
+    /*
+        message{10}.get<float>();
+    */
+
+    // Bulk copy of a million messages.
+    // (Compile with optimizations enabled to get meaningful numbers.)
+    {
+        constexpr std::size_t n{1000000};
+
+        benchmark_bulk_copy<legacy_message>("hand-rolled tagged union", n);
+        benchmark_bulk_copy<message>("var<int, float, char>", n);
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,278 @@
+#!/usr/bin/env python3
+
+# Copyright (c) 2015 Vittorio Romeo
+# License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+# http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+# Compile-time benchmark for `static_if`, in the style of metabench
+# (https://github.com/ldionne/metabench).
+
+# Every `.then`/`.else_if` link of a `static_if` chain instantiates a new
+# `static_if_impl` or `static_if_result` type, plus a closure type. To see how
+# this scales, we generate translation units where `run<TI>()` is instantiated
+# for `TI` in `[0, instantiations)`, and every instantiation selects one of
+# `branches` branches, using one of these strategies:
+#
+# * `baseline`: no branching at all, to measure the fixed costs;
+#
+# * `static_if`: a `static_if(...).then(...).else_if(...)` chain;
+#
+# * `if_constexpr`: the C++17 `if constexpr` lowering of the same chain;
+#
+# * `tag_dispatch`: one overload per branch, selected by an
+#   `std::integral_constant` tag;
+#
+# * `static_switch`: a single `static_switch(pred, f, ..., default)` call.
+#
+# Every translation unit is compiled on its own, and we record the wall-clock
+# compilation time and the peak memory usage of the compiler.
+
+# Usage:
+#
+#   ./ctbench.py --branches 1,10,25,50 --instantiations 100,1000,2000
+#
+# Run `./ctbench.py --help` for all options.
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+PRELUDE = """\
+#include <utility>
+#include <type_traits>
+#include "static_if.hpp"
+#include "static_switch.hpp"
+
+"""
+
+EPILOGUE = """
+template <int... TIs>
+int run_all(std::integer_sequence<int, TIs...>)
+{{
+    // An array, rather than a fold expression, to avoid hitting the
+    // compilers' parenthesis nesting limits.
+    int results[]{{run<TIs>()...}};
+
+    int sum{{0}};
+    for(auto r : results) sum += r;
+    return sum;
+}}
+
+int main()
+{{
+    return run_all(std::make_integer_sequence<int, {instantiations}>{{}}) != 0;
+}}
+"""
+
+
+def gen_baseline(branches):
+    return """\
+template <int TI>
+int run()
+{
+    return TI;
+}
+"""
+
+
+def gen_static_if(branches):
+    links = []
+    for b in range(branches):
+        head = "static_if" if b == 0 else "        .else_if"
+        links.append("{}(bool_v<(TI % {} == {})>)\n"
+                     "        .then([](auto x)\n"
+                     "            {{\n"
+                     "                return x * {};\n"
+                     "            }})".format(head, branches, b, b + 1))
+
+    return """\
+template <int TI>
+int run()
+{{
+    return {}
+        .else_([](auto x)
+            {{
+                return x;
+            }})(TI);
+}}
+""".format("\n".join(links))
+
+
+def gen_if_constexpr(branches):
+    links = []
+    for b in range(branches):
+        head = "if constexpr" if b == 0 else "    else if constexpr"
+        links.append("{}(TI % {} == {})\n"
+                     "    {{\n"
+                     "        return TI * {};\n"
+                     "    }}".format(head, branches, b, b + 1))
+
+    return """\
+template <int TI>
+int run()
+{{
+    {}
+    else
+    {{
+        return TI;
+    }}
+}}
+""".format("\n".join(links))
+
+
+def gen_tag_dispatch(branches):
+    overloads = []
+    for b in range(branches):
+        overloads.append("template <int TI>\n"
+                         "int branch(std::integral_constant<int, {}>)\n"
+                         "{{\n"
+                         "    return TI * {};\n"
+                         "}}\n".format(b, b + 1))
+
+    return """\
+{}
+template <int TI>
+int run()
+{{
+    return branch<TI>(std::integral_constant<int, TI % {}>{{}});
+}}
+""".format("\n".join(overloads), branches)
+
+
+def gen_static_switch(branches):
+    pairs = []
+    for b in range(branches):
+        pairs.append("bool_v<(TI % {} == {})>,\n"
+                     "        [](auto x)\n"
+                     "        {{\n"
+                     "            return x * {};\n"
+                     "        }},".format(branches, b, b + 1))
+
+    return """\
+template <int TI>
+int run()
+{{
+    return static_switch({}
+        [](auto x)
+        {{
+            return x;
+        }})(TI);
+}}
+""".format("\n        ".join(pairs))
+
+
+STRATEGIES = {
+    "baseline": gen_baseline,
+    "static_if": gen_static_if,
+    "if_constexpr": gen_if_constexpr,
+    "tag_dispatch": gen_tag_dispatch,
+    "static_switch": gen_static_switch,
+}
+
+
+def generate(strategy, branches, instantiations):
+    return (PRELUDE + STRATEGIES[strategy](branches) +
+            EPILOGUE.format(instantiations=instantiations))
+
+
+def compile_once(args, source_path):
+    cmd = [args.compiler, "-std=" + args.std, "-I", HERE] + args.flags + [
+        "-c", source_path, "-o", os.devnull]
+
+    # Diagnostics go to a temporary file rather than a pipe: nobody reads the
+    # pipe while we're blocked in `wait4`, so a compiler filling it up with
+    # errors would deadlock.
+    with tempfile.TemporaryFile() as err:
+        start = time.perf_counter()
+        p = subprocess.Popen(cmd, stderr=err)
+
+        # `wait4` reports the peak resident set size of the compiler driver
+        # and of its children (e.g. `cc1plus`), in kilobytes on Linux.
+        _, status, usage = os.wait4(p.pid, 0)
+        elapsed = time.perf_counter() - start
+
+        err.seek(0)
+        stderr = err.read().decode(errors="replace")
+
+    if status != 0:
+        sys.exit("compilation of {} failed:\n{}".format(source_path, stderr))
+
+    return elapsed, usage.ru_maxrss
+
+
+def parse_list(s):
+    return [int(x) for x in s.split(",")]
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Compile-time benchmark of static_if vs if constexpr vs "
+        "tag dispatch vs static_switch.")
+    parser.add_argument("--compiler", default=os.environ.get("CXX", "g++"))
+    parser.add_argument("--std", default="c++17")
+    parser.add_argument("--flags", default="-O0",
+                        help="extra compiler flags, space-separated")
+    parser.add_argument("--branches", type=parse_list, default="1,10,25,50")
+    parser.add_argument("--instantiations", type=parse_list,
+                        default="100,500,1000")
+    parser.add_argument("--strategies", default=",".join(STRATEGIES))
+    parser.add_argument("--repeat", type=int, default=3,
+                        help="compilations per data point (best is kept)")
+    parser.add_argument("--keep", metavar="DIR",
+                        help="write the generated sources to DIR")
+    parser.add_argument("--csv", action="store_true")
+    args = parser.parse_args()
+
+    args.flags = args.flags.split()
+    strategies = args.strategies.split(",")
+    for s in strategies:
+        if s not in STRATEGIES:
+            sys.exit("unknown strategy '{}'".format(s))
+
+    out_dir = args.keep or tempfile.mkdtemp(prefix="ctbench_")
+    os.makedirs(out_dir, exist_ok=True)
+
+    if args.csv:
+        print("strategy,branches,instantiations,seconds,max_rss_kb")
+    else:
+        print("{:<14}{:>10}{:>16}{:>12}{:>16}".format(
+            "strategy", "branches", "instantiations", "seconds",
+            "max_rss_kb"))
+
+    for instantiations in args.instantiations:
+        for branches in args.branches:
+            for strategy in strategies:
+                path = os.path.join(out_dir, "{}_{}_{}.cpp".format(
+                    strategy, branches, instantiations))
+
+                with open(path, "w") as f:
+                    f.write(generate(strategy, branches, instantiations))
+
+                results = [compile_once(args, path)
+                           for _ in range(args.repeat)]
+                seconds = min(r[0] for r in results)
+                rss = min(r[1] for r in results)
+
+                if args.csv:
+                    print("{},{},{},{:.3f},{}".format(
+                        strategy, branches, instantiations, seconds, rss))
+                else:
+                    print("{:<14}{:>10}{:>16}{:>12.3f}{:>16}".format(
+                        strategy, branches, instantiations, seconds, rss))
+
+                sys.stdout.flush()
+
+                if not args.keep:
+                    os.remove(path)
+
+    if not args.keep:
+        os.rmdir(out_dir)
+
+
+if __name__ == "__main__":
+    main()
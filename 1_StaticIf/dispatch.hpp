@@ -0,0 +1,64 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#pragma once
+
+#include <stdexcept>
+#include <utility>
+#include <type_traits>
+#include "static_if.hpp"
+
+// `dispatch<TBegin, TEnd>(value, f)` calls `f(int_v<I>)`, where `I == value`,
+// for any run-time `value` in `[TBegin, TEnd)`. (`int_v<I>` is an
+// `std::integral_constant<int, I>`.)
+
+// `f` is instantiated once per value in the range, and a `constexpr` table of
+// function pointers to these instantiations is built at compile-time: the
+// dispatch itself is one bounds check and one indirect call. Out of range
+// values throw `std::out_of_range`, even with `NDEBUG` defined, as indexing the
+// table with them would call through a garbage pointer.
+
+template <int TI>
+using int_ = std::integral_constant<int, TI>;
+
+template <int TI>
+constexpr int_<TI> int_v{};
+
+namespace impl
+{
+    template <int TBegin, typename TF, int... TIs>
+    constexpr auto make_dispatch_table(std::integer_sequence<int, TIs...>)
+    {
+        using result_type = std::common_type_t<decltype(
+            std::declval<TF>()(int_v<TBegin + TIs>))...>;
+
+        using entry_type = result_type (*)(TF&&);
+
+        struct table
+        {
+            entry_type _entries[sizeof...(TIs)];
+        };
+
+        return table{{[](TF&& f) -> result_type
+            {
+                return FWD(f)(int_v<TBegin + TIs>);
+            }...}};
+    }
+}
+
+template <int TBegin, int TEnd, typename TF>
+decltype(auto) dispatch(int value, TF&& f)
+{
+    static_assert(TBegin < TEnd, "The range `[TBegin, TEnd)` is empty.");
+
+    static constexpr auto table(impl::make_dispatch_table<TBegin, TF>(
+        std::make_integer_sequence<int, TEnd - TBegin>{}));
+
+    if(value < TBegin || value >= TEnd)
+    {
+        throw std::out_of_range{"`dispatch`: value out of range."};
+    }
+
+    return table._entries[value - TBegin](FWD(f));
+}
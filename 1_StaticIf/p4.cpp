@@ -0,0 +1,112 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <utility>
+#include <iostream>
+#include <type_traits>
+#include <string>
+#include "static_switch.hpp"
+
+// Matching one of N predicates with `static_if` requires N chained
+// `.else_if(...).then(...)` calls. Every link instantiates a new
+// `static_if_impl` specialization, so compile times grow with the length of
+// the chain. (Run `./ctbench.py --strategies static_if,static_switch` to
+// measure it.)
+
+// `static_switch` flattens the chain into a single call: see
+// `static_switch.hpp` for the implementation.
+
+struct banana
+{
+    void eat()
+    {
+    }
+};
+
+struct water
+{
+    void drink()
+    {
+    }
+};
+
+struct pill
+{
+    void swallow()
+    {
+    }
+};
+
+template <typename T>
+constexpr bool is_solid{false};
+
+template <>
+constexpr bool is_solid<banana>{true};
+
+template <typename T>
+constexpr bool is_liquid{false};
+
+template <>
+constexpr bool is_liquid<water>{true};
+
+template <typename T>
+constexpr bool is_medicine{false};
+
+template <>
+constexpr bool is_medicine<pill>{true};
+
+template <typename T>
+auto consume(T&& x)
+{
+    // Only the body of the selected lambda is instantiated: `y.eat()` is never
+    // instantiated for `water`.
+    using type = std::decay_t<T>;
+
+    return static_switch(bool_v<is_solid<type>>,
+        [](auto&& y)
+        {
+            y.eat();
+            return "ate solid food";
+        },
+        bool_v<is_liquid<type>>,
+        [](auto&& y)
+        {
+            y.drink();
+            return "drank liquid food";
+        },
+        bool_v<is_medicine<type>>,
+        [](auto&& y)
+        {
+            y.swallow();
+            return "took medicine";
+        },
+        [](auto&&)
+        {
+            return "cannot consume";
+        })(FWD(x));
+}
+
+int main()
+{
+    std::cout << consume(banana{}) << "\n"
+              << consume(water{}) << "\n"
+              << consume(pill{}) << "\n"
+              << consume(int{}) << "\n";
+
+    // The first matching predicate wins.
+    auto first(static_switch(bool_v<false>, [] { return 0; }, bool_v<true>,
+        [] { return 1; }, bool_v<true>, [] { return 2; }, [] { return 3; })());
+
+    // Only the default function:
+    auto only_default(static_switch([] { return 42; })());
+
+    std::cout << first << " " << only_default << "\n";
+
+    // Does not compile, as intended (missing default function):
+    /*
+        static_switch(bool_v<true>, [] { });
+    */
+
+    return 0;
+}
@@ -0,0 +1,152 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <utility>
+#include <iostream>
+#include <type_traits>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+#include "dispatch.hpp"
+
+// `static_if` requires its predicate to be known at compile-time. Kernels,
+// however, often take run-time parameters with a small set of possible values
+// (vector width, channel count, bit depth), and we want a specialized
+// instantiation for each of them.
+
+// `dispatch` bridges the two worlds: it turns a run-time `int` into an
+// `std::integral_constant`, with a single indirect call. See `dispatch.hpp`
+// for the implementation.
+
+// Example: mixing down interleaved audio frames with 1 to 8 channels. The
+// kernel is written once, and takes the channel count either as a run-time
+// `int` or as an `std::integral_constant`.
+
+template <typename TChannels>
+void mix_down(const float* in, float* out, std::size_t frames,
+    TChannels channels) noexcept
+{
+    for(std::size_t f{0}; f < frames; ++f)
+    {
+        // With an `std::integral_constant`, the trip count of this loop is
+        // known at compile-time, so it can be fully unrolled.
+        float sum{0.f};
+        for(int c{0}; c < channels; ++c) sum += in[f * channels + c];
+
+        out[f] = sum;
+    }
+}
+
+template <typename TF>
+auto time_ms(TF&& f)
+{
+    auto start(std::chrono::high_resolution_clock::now());
+    f();
+    auto end(std::chrono::high_resolution_clock::now());
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main()
+{
+    // Basic usage:
+    {
+        int value{3};
+
+        auto result(dispatch<0, 8>(value, [](auto i)
+            {
+                // `i` is an `std::integral_constant`: its value can be used
+                // in constant expressions.
+                static_assert(decltype(i){} >= 0 && decltype(i){} < 8, "");
+                return i * 10;
+            }));
+
+        assert(result == 30);
+        (void)result;
+
+        // Combined with `static_if`:
+        auto name(dispatch<1, 4>(value, [](auto i)
+            {
+                return static_if(bool_v<(i == 1)>)
+                    .then([](auto)
+                        {
+                            return "mono";
+                        })
+                    .else_if(bool_v<(i == 2)>)
+                    .then([](auto)
+                        {
+                            return "stereo";
+                        })
+                    .else_([](auto)
+                        {
+                            return "surround";
+                        })(i);
+            }));
+
+        std::cout << name << "\n";
+
+        // Out of range values throw, even with `NDEBUG` defined.
+        auto thrown(false);
+        try
+        {
+            dispatch<0, 8>(8, [](auto)
+                {
+                });
+        }
+        catch(const std::out_of_range&)
+        {
+            thrown = true;
+        }
+
+        assert(thrown);
+        (void)thrown;
+    }
+
+    // Does not compile, as intended (empty range):
+    /*
+        dispatch<0, 0>(0, [](auto) { });
+    */
+
+    // Mixing down 1M frames, for every channel count.
+    // (Compile with optimizations enabled to get meaningful numbers.)
+    {
+        constexpr std::size_t frames{1000000};
+        constexpr int repetitions{20};
+
+        std::vector<float> in(frames * 8, 0.5f);
+        std::vector<float> out_generic(frames), out_specialized(frames);
+
+        for(int channels{1}; channels <= 8; ++channels)
+        {
+            auto generic_ms(time_ms([&]
+                {
+                    for(int r{0}; r < repetitions; ++r)
+                    {
+                        mix_down(in.data(), out_generic.data(), frames,
+                            channels);
+                    }
+                }));
+
+            auto specialized_ms(time_ms([&]
+                {
+                    for(int r{0}; r < repetitions; ++r)
+                    {
+                        dispatch<1, 9>(channels, [&](auto c)
+                            {
+                                mix_down(in.data(), out_specialized.data(),
+                                    frames, c);
+                            });
+                    }
+                }));
+
+            assert(out_generic == out_specialized);
+
+            std::cout << channels << " channels: generic " << generic_ms
+                      << "ms, specialized " << specialized_ms << "ms\n";
+        }
+    }
+
+    return 0;
+}
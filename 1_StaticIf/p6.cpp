@@ -0,0 +1,250 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <utility>
+#include <iostream>
+#include <type_traits>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+#include "dispatch.hpp"
+
+// Inner loops often test a few run-time flags on every iteration, even though
+// the flags never change during the loop. Compilers can sometimes "unswitch"
+// the loop (hoisting the tests and duplicating the loop for every combination
+// of flags), but they are conservative about it, as it multiplies code size.
+
+// We can unswitch manually: `with_flags(a, b, ..., f)` turns every run-time
+// `bool` into a `bool_v<true>` or a `bool_v<false>` once, outside the loop,
+// and calls `f` with them. The loop body can then use `static_if`, or a plain
+// `if`, on compile-time constants.
+
+// The flags are packed into an integer, and `dispatch` selects among the 2^k
+// instantiations of `f` with a single table lookup.
+
+namespace impl
+{
+    // Bit `TBit` of the dispatched index becomes the `TBit`-th flag.
+    template <typename TF, typename TIndex, std::size_t... TBits>
+    decltype(auto) call_with_flags(
+        TF&& f, TIndex, std::index_sequence<TBits...>)
+    {
+        return FWD(f)(bool_v<((TIndex{} >> TBits) & 1) != 0>...);
+    }
+
+    // Flags are converted to `bool` first, so that any "truthy" value (such
+    // as `x & 2`, or a `std::size_t`) sets exactly its own bit.
+    template <typename TTuple, std::size_t... TBits>
+    auto pack_flags(const TTuple& args, std::index_sequence<TBits...>)
+    {
+        int result{0};
+
+        using expander = int[];
+        (void)expander{0, (result |=
+            int{static_cast<bool>(std::get<TBits>(args))} << TBits, 0)...};
+
+        return result;
+    }
+}
+
+template <typename... Ts>
+decltype(auto) with_flags(Ts&&... xs)
+{
+    static_assert(sizeof...(Ts) > 0, "Missing function.");
+
+    // Clamped, so that a missing function doesn't also underflow below.
+    constexpr std::size_t flag_count{
+        sizeof...(Ts) > 0 ? sizeof...(Ts) - 1 : 0};
+
+    // `2^flag_count` instantiations of `f` will be generated.
+    static_assert(flag_count <= 8, "Too many flags.");
+
+    auto args(std::forward_as_tuple(FWD(xs)...));
+    auto&& f(std::get<flag_count>(args));
+
+    using flags_sequence = std::make_index_sequence<flag_count>;
+    const auto index(impl::pack_flags(args, flags_sequence{}));
+
+    return dispatch<0, (1 << flag_count)>(index, [&f](auto i) -> decltype(auto)
+        {
+            return impl::call_with_flags(FWD(f), i, flags_sequence{});
+        });
+}
+
+// Example: converting RGBA pixels to floats, with optional sign conversion,
+// alpha premultiplication and clamping. The kernel is written once, and works
+// both with run-time `bool`s and with `bool_v`s.
+
+struct pixel
+{
+    std::int16_t _r, _g, _b, _a;
+};
+
+struct fpixel
+{
+    float _r, _g, _b, _a;
+
+    bool operator==(const fpixel& rhs) const noexcept
+    {
+        return _r == rhs._r && _g == rhs._g && _b == rhs._b && _a == rhs._a;
+    }
+};
+
+template <typename TSigned, typename TAlpha, typename TClamp>
+void convert(const pixel* in, fpixel* out, std::size_t n, float gain,
+    TSigned is_signed, TAlpha has_alpha, TClamp needs_clamp) noexcept
+{
+    auto to_float([&](std::int16_t x)
+        {
+            if(is_signed) return x / 32768.f;
+            return static_cast<std::uint16_t>(x) / 65535.f;
+        });
+
+    for(std::size_t i{0}; i < n; ++i)
+    {
+        fpixel p{to_float(in[i]._r), to_float(in[i]._g), to_float(in[i]._b),
+            has_alpha ? to_float(in[i]._a) : 1.f};
+
+        if(has_alpha)
+        {
+            p._r *= p._a;
+            p._g *= p._a;
+            p._b *= p._a;
+        }
+
+        p._r *= gain;
+        p._g *= gain;
+        p._b *= gain;
+
+        if(needs_clamp)
+        {
+            p._r = std::min(std::max(p._r, 0.f), 1.f);
+            p._g = std::min(std::max(p._g, 0.f), 1.f);
+            p._b = std::min(std::max(p._b, 0.f), 1.f);
+        }
+
+        out[i] = p;
+    }
+}
+
+template <typename TF>
+auto time_ms(TF&& f)
+{
+    auto start(std::chrono::high_resolution_clock::now());
+    f();
+    auto end(std::chrono::high_resolution_clock::now());
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main()
+{
+    // Basic usage:
+    {
+        bool a{true}, b{false};
+
+        auto name(with_flags(a, b, [](auto x, auto y)
+            {
+                // `x` and `y` are `bool_v`s.
+                return static_if(bool_v<(x && y)>)
+                    .then([](auto)
+                        {
+                            return "both";
+                        })
+                    .else_if(bool_v<(x || y)>)
+                    .then([](auto)
+                        {
+                            return "one";
+                        })
+                    .else_([](auto)
+                        {
+                            return "none";
+                        })(0);
+            }));
+
+        std::cout << name << "\n";
+
+        // Without flags, `f` is just called.
+        auto answer(with_flags([]
+            {
+                return 42;
+            }));
+
+        assert(answer == 42);
+        (void)answer;
+
+        // Flags can be anything convertible to `bool`.
+        int bits{2};
+        std::size_t count{3};
+
+        auto flags(with_flags(bits & 2, count, [](auto x, auto y)
+            {
+                return int{x} + 2 * int{y};
+            }));
+
+        assert(flags == 3);
+        (void)flags;
+    }
+
+    // Converting 1M pixels, for every combination of flags.
+    // (Compile with optimizations enabled to get meaningful numbers.)
+    {
+        constexpr std::size_t n{1000000};
+        constexpr int repetitions{20};
+
+        std::vector<pixel> in(n);
+        for(std::size_t i{0}; i < n; ++i)
+        {
+            auto x(static_cast<std::int16_t>(i * 7919));
+            auto channel([x](int d)
+                {
+                    return static_cast<std::int16_t>(x / d);
+                });
+
+            in[i] = pixel{channel(1), channel(2), channel(3), channel(4)};
+        }
+
+        std::vector<fpixel> out_runtime(n), out_unswitched(n);
+
+        for(int flags{0}; flags < 8; ++flags)
+        {
+            const bool is_signed(flags & 1), has_alpha(flags & 2),
+                needs_clamp(flags & 4);
+
+            auto runtime_ms(time_ms([&]
+                {
+                    for(int r{0}; r < repetitions; ++r)
+                    {
+                        convert(in.data(), out_runtime.data(), n, 1.5f,
+                            is_signed, has_alpha, needs_clamp);
+                    }
+                }));
+
+            auto unswitched_ms(time_ms([&]
+                {
+                    for(int r{0}; r < repetitions; ++r)
+                    {
+                        with_flags(is_signed, has_alpha, needs_clamp,
+                            [&](auto s, auto a, auto c)
+                            {
+                                convert(in.data(), out_unswitched.data(), n,
+                                    1.5f, s, a, c);
+                            });
+                    }
+                }));
+
+            assert(out_runtime == out_unswitched);
+
+            std::cout << "signed " << is_signed << ", alpha " << has_alpha
+                      << ", clamp " << needs_clamp << ": run-time flags "
+                      << runtime_ms << "ms, with_flags " << unswitched_ms
+                      << "ms\n";
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,485 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#include <utility>
+#include <iostream>
+#include <type_traits>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "static_if.hpp"
+
+// `for_args(f, xs...)`, used in `p3.cpp`, calls `f` on every argument, one
+// after another. Here's a minimal version of it:
+
+template <typename TF, typename... Ts>
+void for_args(TF&& f, Ts&&... xs)
+{
+    using expander = int[];
+    (void)expander{0, ((void)f(FWD(xs)), 0)...};
+}
+
+// When the calls are independent and heavy (processing a heterogeneous set of
+// columns, or updating independent subsystems), we can run them in parallel.
+// `parallel_for_args(f, xs...)` submits one task per argument to a thread
+// pool, and returns when all of them are done:
+//
+// * every argument is forwarded to `f` exactly once, with `FWD` semantics:
+//   tasks only store pointers to the arguments, which outlive them as
+//   `parallel_for_args` doesn't return before the tasks complete;
+//
+// * if any call throws, the first exception is rethrown to the caller, after
+//   all the other calls have completed;
+//
+// * `f` is called concurrently from multiple threads, so it must not mutate
+//   shared state without synchronization;
+//
+// * the calling thread doesn't just block: it runs tasks too, so that nested
+//   `parallel_for_args` calls cannot deadlock the pool.
+
+// Task costs can be very uneven, so the pool uses work stealing: every worker
+// has its own queue, and idle workers steal tasks from the others.
+
+namespace impl
+{
+    struct task_batch
+    {
+        std::atomic<std::size_t> _remaining;
+        std::mutex _error_mutex;
+        std::exception_ptr _error;
+
+        task_batch(std::size_t count) noexcept : _remaining{count}
+        {
+        }
+    };
+
+    // Type-erased, allocation-free reference to "call `f` with `x`".
+    struct task
+    {
+        task_batch* _batch;
+        void* _f;
+        void* _x;
+        void (*_fn)(void*, void*);
+
+        void operator()() const noexcept
+        {
+            try
+            {
+                _fn(_f, _x);
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> l{_batch->_error_mutex};
+                if(!_batch->_error) _batch->_error = std::current_exception();
+            }
+
+            _batch->_remaining.fetch_sub(1, std::memory_order_release);
+        }
+    };
+
+    template <typename T>
+    auto to_void_ptr(T& x) noexcept
+    {
+        return const_cast<void*>(static_cast<const void*>(std::addressof(x)));
+    }
+
+    // `T` is the forwarding reference type of the argument.
+    template <typename TF, typename T>
+    void call_forwarded(void* f, void* x)
+    {
+        auto& arg(*static_cast<std::remove_reference_t<T>*>(x));
+        (*static_cast<TF*>(f))(static_cast<T&&>(arg));
+    }
+}
+
+class work_stealing_pool
+{
+private:
+    struct worker_queue
+    {
+        std::mutex _mutex;
+        std::deque<impl::task> _tasks;
+    };
+
+    std::vector<std::unique_ptr<worker_queue>> _queues;
+    std::vector<std::thread> _threads;
+
+    std::atomic<std::size_t> _pending{0};
+    std::atomic<std::size_t> _next_queue{0};
+    std::atomic<bool> _stop{false};
+
+    std::mutex _sleep_mutex;
+    std::condition_variable _cv;
+
+    // The pool and queue of the current thread, if it's a worker.
+    static thread_local const work_stealing_pool* _current_pool;
+    static thread_local std::size_t _current_index;
+
+    auto own_queue_index() noexcept
+    {
+        // External threads push round-robin, and steal from everyone.
+        return _current_pool == this
+                   ? _current_index
+                   : _next_queue.fetch_add(1, std::memory_order_relaxed) %
+                         _queues.size();
+    }
+
+    void wake_one() noexcept
+    {
+        // Taking the lock prevents a worker from missing the notification
+        // between checking `_pending` and going to sleep.
+        std::lock_guard<std::mutex> l{_sleep_mutex};
+        _cv.notify_one();
+    }
+
+    // If this throws (e.g. `std::bad_alloc`), `t` was not queued.
+    void push(std::size_t index, const impl::task& t)
+    {
+        {
+            auto& q(*_queues[index]);
+            std::lock_guard<std::mutex> l{q._mutex};
+            q._tasks.push_back(t);
+        }
+
+        _pending.fetch_add(1, std::memory_order_release);
+        wake_one();
+    }
+
+    bool try_pop(std::size_t index, impl::task& out, bool steal)
+    {
+        auto& q(*_queues[index]);
+        std::lock_guard<std::mutex> l{q._mutex};
+        if(q._tasks.empty()) return false;
+
+        // The owner works LIFO, for locality. Thieves take the oldest tasks,
+        // which are the least likely to be "hot" in the owner's cache.
+        if(steal)
+        {
+            out = q._tasks.front();
+            q._tasks.pop_front();
+        }
+        else
+        {
+            out = q._tasks.back();
+            q._tasks.pop_back();
+        }
+
+        _pending.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool try_run_one(std::size_t index)
+    {
+        impl::task t;
+
+        bool found{try_pop(index, t, false)};
+        for(std::size_t i{1}; !found && i < _queues.size(); ++i)
+        {
+            found = try_pop((index + i) % _queues.size(), t, true);
+        }
+
+        if(found) t();
+        return found;
+    }
+
+    // Helps out until every task of `b` is done.
+    void wait_for(const impl::task_batch& b)
+    {
+        const auto index(own_queue_index());
+        while(b._remaining.load(std::memory_order_acquire) > 0)
+        {
+            if(!try_run_one(index)) std::this_thread::yield();
+        }
+    }
+
+    void worker_loop(std::size_t index)
+    {
+        _current_pool = this;
+        _current_index = index;
+
+        while(true)
+        {
+            if(try_run_one(index)) continue;
+
+            std::unique_lock<std::mutex> l{_sleep_mutex};
+            _cv.wait(l, [this]
+                {
+                    return _stop || _pending.load() > 0;
+                });
+
+            if(_stop) return;
+        }
+    }
+
+public:
+    explicit work_stealing_pool(
+        std::size_t thread_count = std::thread::hardware_concurrency())
+    {
+        thread_count = std::max<std::size_t>(thread_count, 1);
+
+        for(std::size_t i{0}; i < thread_count; ++i)
+        {
+            _queues.emplace_back(std::make_unique<worker_queue>());
+        }
+
+        for(std::size_t i{0}; i < thread_count; ++i)
+        {
+            _threads.emplace_back([this, i]
+                {
+                    worker_loop(i);
+                });
+        }
+    }
+
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+    ~work_stealing_pool()
+    {
+        {
+            std::lock_guard<std::mutex> l{_sleep_mutex};
+            _stop = true;
+        }
+
+        _cv.notify_all();
+        for(auto& t : _threads) t.join();
+    }
+
+    auto size() const noexcept
+    {
+        return _threads.size();
+    }
+
+    // This overload will be called when there are no arguments.
+    template <typename TF>
+    void for_args(TF&&) noexcept
+    {
+    }
+
+    template <typename TF, typename... Ts>
+    void for_args(TF&& f, Ts&&... xs)
+    {
+        using f_type = std::remove_reference_t<TF>;
+        impl::task_batch b{sizeof...(Ts)};
+
+        const impl::task tasks[]{impl::task{&b, impl::to_void_ptr(f),
+            impl::to_void_ptr(xs), &impl::call_forwarded<f_type, Ts>}...};
+
+        std::size_t pushed{0};
+        try
+        {
+            for(const auto& t : tasks)
+            {
+                push(own_queue_index(), t);
+                ++pushed;
+            }
+        }
+        catch(...)
+        {
+            // The queued tasks point to `b`, `f` and `xs...`: they must be
+            // done before the exception leaves this frame. The other ones
+            // will never run.
+            b._remaining.fetch_sub(
+                sizeof...(Ts) - pushed, std::memory_order_relaxed);
+
+            wait_for(b);
+            throw;
+        }
+
+        wait_for(b);
+
+        if(b._error) std::rethrow_exception(b._error);
+    }
+};
+
+thread_local const work_stealing_pool* work_stealing_pool::_current_pool{
+    nullptr};
+
+thread_local std::size_t work_stealing_pool::_current_index{0};
+
+inline auto& default_pool()
+{
+    static work_stealing_pool p;
+    return p;
+}
+
+template <typename TF, typename... Ts>
+void parallel_for_args(TF&& f, Ts&&... xs)
+{
+    default_pool().for_args(FWD(f), FWD(xs)...);
+}
+
+// Example: summing a heterogeneous set of columns with very different sizes.
+
+template <typename T>
+auto make_column(std::size_t n)
+{
+    std::vector<T> result(n);
+    for(std::size_t i{0}; i < n; ++i) result[i] = static_cast<T>(i % 100);
+    return result;
+}
+
+// Deliberately expensive, so that every call is heavy.
+template <typename T>
+auto heavy_sum(const std::vector<T>& column)
+{
+    double result{0};
+    for(const auto& x : column) result += std::sqrt(std::sqrt(double(x)));
+    return result;
+}
+
+template <typename TF>
+auto time_ms(TF&& f)
+{
+    auto start(std::chrono::high_resolution_clock::now());
+    f();
+    auto end(std::chrono::high_resolution_clock::now());
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main()
+{
+    // Basic usage, with forwarding:
+    {
+        std::atomic<int> lvalues{0}, rvalues{0};
+        std::string s{"hello"};
+
+        parallel_for_args(
+            [&](auto&& x)
+            {
+                static_if(bool_v<std::is_lvalue_reference<decltype(x)>{}>)
+                    .then([&](auto&)
+                        {
+                            ++lvalues;
+                        })
+                    .else_([&](auto&& y)
+                        {
+                            // Rvalues can be moved from.
+                            auto sink(std::move(y));
+                            (void)sink;
+                            ++rvalues;
+                        })(FWD(x));
+            },
+            s, std::string{"world"}, std::make_unique<int>(42), 1);
+
+        assert(lvalues == 1 && rvalues == 3);
+        assert(s == "hello");
+
+        // No arguments, no calls.
+        parallel_for_args([](int)
+            {
+                assert(false);
+            });
+    }
+
+    // Exception propagation:
+    {
+        std::atomic<int> calls{0};
+
+        try
+        {
+            parallel_for_args(
+                [&](int x)
+                {
+                    ++calls;
+                    if(x == 2) throw std::runtime_error{"bad column"};
+                },
+                1, 2, 3, 4);
+
+            assert(false);
+        }
+        catch(const std::runtime_error& e)
+        {
+            // All the other calls still ran.
+            assert(calls == 4);
+            std::cout << "caught: " << e.what() << "\n";
+        }
+    }
+
+    // Nested calls don't deadlock, even on a single worker:
+    {
+        work_stealing_pool p{1};
+        std::atomic<int> calls{0};
+
+        p.for_args(
+            [&](int)
+            {
+                p.for_args(
+                    [&](int)
+                    {
+                        ++calls;
+                    },
+                    1, 2, 3);
+            },
+            1, 2);
+
+        assert(calls == 6);
+    }
+
+    // Summing columns of uneven sizes.
+    // (Compile with optimizations enabled to get meaningful numbers.)
+    {
+        constexpr std::size_t m{1000000};
+
+        auto c0(make_column<int>(32 * m));
+        auto c1(make_column<float>(2 * m));
+        auto c2(make_column<double>(16 * m));
+        auto c3(make_column<short>(1 * m));
+        auto c4(make_column<long>(8 * m));
+        auto c5(make_column<float>(1 * m));
+        auto c6(make_column<double>(4 * m));
+        auto c7(make_column<int>(24 * m));
+
+        std::atomic<double> seq_total{0}, par_total{0};
+
+        auto add([](std::atomic<double>& total, double x)
+            {
+                auto old(total.load());
+                while(!total.compare_exchange_weak(old, old + x))
+                {
+                }
+            });
+
+        auto seq_ms(time_ms([&]
+            {
+                for_args(
+                    [&](const auto& c)
+                    {
+                        add(seq_total, heavy_sum(c));
+                    },
+                    c0, c1, c2, c3, c4, c5, c6, c7);
+            }));
+
+        auto par_ms(time_ms([&]
+            {
+                parallel_for_args(
+                    [&](const auto& c)
+                    {
+                        add(par_total, heavy_sum(c));
+                    },
+                    c0, c1, c2, c3, c4, c5, c6, c7);
+            }));
+
+        // Additions happen in a different order, so we allow some rounding.
+        assert(std::abs(seq_total - par_total) < 1e-6 * seq_total);
+
+        std::cout << "for_args:          " << seq_ms << "ms\n"
+                  << "parallel_for_args: " << par_ms << "ms ("
+                  << default_pool().size() << " workers)\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#pragma once
+
+#include <utility>
+#include <type_traits>
+
+// The `static_if` implementation from `p2.cpp`, without the commentary, so
+// that it can be shared by the following code segments and benchmarks.
+
+#define FWD(...) ::std::forward<decltype(__VA_ARGS__)>(__VA_ARGS__)
+
+template <bool TX>
+using bool_ = std::integral_constant<bool, TX>;
+
+template <bool TX>
+constexpr bool_<TX> bool_v{};
+
+template <typename TPredicate>
+auto static_if(TPredicate) noexcept;
+
+namespace impl
+{
+    template <typename TFunctionToCall>
+    struct static_if_result;
+
+    template <bool TPredicateResult>
+    struct static_if_impl;
+
+    template <>
+    struct static_if_impl<false>
+    {
+        template <typename TF>
+        auto& then(TF&&)
+        {
+            return *this;
+        }
+
+        template <typename TF>
+        auto else_(TF&& f) noexcept
+        {
+            return static_if_result<TF>(FWD(f));
+        }
+
+        template <typename TPredicate>
+        auto else_if(TPredicate) noexcept
+        {
+            return static_if(TPredicate{});
+        }
+
+        template <typename... Ts>
+        auto operator()(Ts&&...) noexcept
+        {
+        }
+    };
+
+    template <>
+    struct static_if_impl<true>
+    {
+        template <typename TF>
+        auto& else_(TF&&) noexcept
+        {
+            return *this;
+        }
+
+        template <typename TF>
+        auto then(TF&& f) noexcept
+        {
+            return static_if_result<TF>(FWD(f));
+        }
+
+        template <typename TPredicate>
+        auto& else_if(TPredicate) noexcept
+        {
+            return *this;
+        }
+    };
+
+    template <typename TFunctionToCall>
+    struct static_if_result : TFunctionToCall
+    {
+        template <typename TFFwd>
+        static_if_result(TFFwd&& f) noexcept : TFunctionToCall(FWD(f))
+        {
+        }
+
+        template <typename TF>
+        auto& else_(TF&&) noexcept
+        {
+            return *this;
+        }
+
+        template <typename TF>
+        auto& then(TF&&) noexcept
+        {
+            return *this;
+        }
+
+        template <typename TPredicate>
+        auto& else_if(TPredicate) noexcept
+        {
+            return *this;
+        }
+    };
+}
+
+template <typename TPredicate>
+auto static_if(TPredicate) noexcept
+{
+    return impl::static_if_impl<TPredicate{}>{};
+}
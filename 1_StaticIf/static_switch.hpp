@@ -0,0 +1,125 @@
+// Copyright (c) 2015 Vittorio Romeo
+// License: AFL 3.0 | https://opensource.org/licenses/AFL-3.0
+// http://vittorioromeo.info | vittorio.romeo@outlook.com
+
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+#include "static_if.hpp"
+
+// `static_switch(pred_0, f_0, pred_1, f_1, ..., default_f)` returns the
+// function following the first `bool_v<true>` predicate, or `default_f`.
+
+// Unlike a `static_if` chain, which instantiates a new `static_if_impl` or
+// `static_if_result` type and a few member function templates per link, the
+// selected index is computed by a single `constexpr` loop over an array of
+// predicate values, and the selected argument is extracted with a constant
+// instantiation depth. Only the selected function is called, so only its body
+// is instantiated.
+
+namespace impl
+{
+    // Arguments are classified with plain overload resolution, inside
+    // `decltype`: this doesn't instantiate any template per argument.
+    struct true_predicate
+    {
+        static constexpr bool is_predicate{true};
+        static constexpr bool value{true};
+    };
+
+    struct false_predicate
+    {
+        static constexpr bool is_predicate{true};
+        static constexpr bool value{false};
+    };
+
+    struct not_a_predicate
+    {
+        static constexpr bool is_predicate{false};
+        static constexpr bool value{false};
+    };
+
+    true_predicate classify(bool_<true>);
+    false_predicate classify(bool_<false>);
+    not_a_predicate classify(...);
+
+    // `predicates` and `matches` contain one entry per argument: predicates
+    // are at even positions, functions at odd ones, and the default function
+    // is last.
+    template <std::size_t TN>
+    constexpr bool valid_switch(const bool (&predicates)[TN]) noexcept
+    {
+        for(std::size_t i{0}; i + 1 < TN; i += 2)
+        {
+            if(!predicates[i]) return false;
+        }
+
+        return TN % 2 == 1;
+    }
+
+    template <std::size_t TN>
+    constexpr std::size_t selected_branch(const bool (&matches)[TN]) noexcept
+    {
+        for(std::size_t i{0}; i + 1 < TN; i += 2)
+        {
+            if(matches[i]) return i + 1;
+        }
+
+        return TN - 1;
+    }
+
+    // Accepts and ignores any pointer.
+    template <std::size_t>
+    using any_ptr = const volatile void*;
+
+    // Selects the `sizeof...(TIs)`-th pointer by skipping the ones before it
+    // in a single overload, instead of recursing.
+    template <typename TSequence>
+    struct nth_ptr;
+
+    template <std::size_t... TIs>
+    struct nth_ptr<std::index_sequence<TIs...>>
+    {
+        template <typename T>
+        static constexpr T* get(any_ptr<TIs>..., T* x, ...) noexcept
+        {
+            return x;
+        }
+    };
+
+    // Only used through pointers, so that it's never instantiated for the
+    // arguments that are not selected.
+    template <typename T>
+    struct type_w
+    {
+        using type = T;
+    };
+
+    template <std::size_t TI, typename... Ts>
+    using nth_type = typename std::remove_pointer_t<decltype(
+        nth_ptr<std::make_index_sequence<TI>>::get(
+            static_cast<type_w<Ts>*>(nullptr)...))>::type;
+}
+
+template <typename... Ts>
+auto static_switch(Ts&&... xs)
+{
+    // No local arrays: unoptimized builds would materialize them on the
+    // stack, in every instantiation.
+    static_assert(impl::valid_switch(
+                      {decltype(impl::classify(xs))::is_predicate...}),
+        "Expected `(predicate, function)...` pairs, followed by a default "
+        "function.");
+
+    constexpr auto selected(
+        impl::selected_branch({decltype(impl::classify(xs))::value...}));
+
+    // Only the selected argument is forwarded. Like `static_if_result`, we
+    // return a copy of the selected function.
+    using selected_type = impl::nth_type<selected, Ts&&...>;
+    auto ptr(impl::nth_ptr<std::make_index_sequence<selected>>::get(&xs...));
+
+    return std::decay_t<selected_type>(static_cast<selected_type>(*ptr));
+}